@@ -0,0 +1,59 @@
+//====================
+//状态变化记录
+//====================
+#pragma once
+#include <QVector>
+#include "Entity.h"
+
+//勇者状态的字段位，用于ChangeSet::heroFields
+enum HeroField : quint32
+{
+    HeroPosition = 1u << 0,
+    HeroFace = 1u << 1,
+    HeroHp = 1u << 2,
+    HeroAtk = 1u << 3,
+    HeroDef = 1u << 4,
+    HeroGold = 1u << 5,
+    HeroKeys = 1u << 6,
+    HeroStats = HeroHp | HeroAtk | HeroDef | HeroGold | HeroKeys,
+};
+
+//比较两份勇者状态，返回发生变化的字段位
+inline quint32 diffHero(const HeroState& before, const HeroState& after)
+{
+    quint32 fields = 0;
+    if (before.posx != after.posx || before.posy != after.posy) fields |= HeroPosition;
+    if (before.face != after.face) fields |= HeroFace;
+    if (before.hp != after.hp) fields |= HeroHp;
+    if (before.atk != after.atk) fields |= HeroAtk;
+    if (before.def != after.def) fields |= HeroDef;
+    if (before.gold != after.gold) fields |= HeroGold;
+    if (before.yellow_key != after.yellow_key || before.blue_key != after.blue_key
+        || before.red_key != after.red_key) fields |= HeroKeys;
+    return fields;
+}
+
+//单个格子的实体变化
+struct TileChange
+{
+    int layer;
+    int x;
+    int y;
+    EntityHandle before;
+    EntityHandle after;
+};
+
+//一次输入（或一次外部操作）造成的全部状态变化
+struct ChangeSet
+{
+    QVector<TileChange> tiles;  //按发生顺序，同一格子可能出现多次
+    HeroState heroBefore;
+    HeroState heroAfter;
+    quint32 heroFields = 0;     //HeroField位
+    int floorBefore = 0;
+    int floorAfter = 0;
+
+    bool floorChanged() const { return floorBefore != floorAfter; }
+    bool heroChanged(quint32 fields = ~0u) const { return (heroFields & fields) != 0; }
+    bool isEmpty() const { return tiles.isEmpty() && heroFields == 0 && !floorChanged(); }
+};
@@ -0,0 +1,33 @@
+//====================
+//战斗计算
+//====================
+#pragma once
+#include <QtGlobal>
+#include "Entity.h"
+
+//战斗结果预测（与勇者当前hp无关，只取决于攻防与怪物属性）
+struct BattleForecast
+{
+    bool canBreak = false;  //勇者攻击力能否破防
+    int turns = 0;          //勇者需要攻击的回合数
+    int damage = 0;         //勇者受到的总伤害
+
+    //当前hp下能否战胜（战后hp必须大于0）
+    bool canDefeat(int heroHp) const { return canBreak && damage < heroHp; }
+};
+
+//勇者先手，每回合双方各攻击一次，怪物倒下的回合不再反击
+inline BattleForecast forecastBattle(int heroAtk, int heroDef, const Monster& monster)
+{
+    BattleForecast result;
+    if (heroAtk <= monster.def)
+        return result; // 攻击力不足，无法破防
+
+    int heroDamage = heroAtk - monster.def;
+    int monsterDamage = qMax(0, monster.atk - heroDef);
+
+    result.canBreak = true;
+    result.turns = (monster.hp + heroDamage - 1) / heroDamage;
+    result.damage = qMax(0, result.turns - 1) * monsterDamage;
+    return result;
+}
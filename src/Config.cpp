@@ -16,9 +16,20 @@ static QStringList configKey =
     "mapLen",           // 地图长度（列数）
     "mapWid",           // 地图宽度（行数）
     "mapLayers",        // 地图层数
+    "floorCacheSize",   // 驻留楼层的内存上限（MB）
     //渲染设置
     "blockSize",        // 格子大小（像素）
     "statusPanelWidth", // 状态面板宽度
+    "animationInterval", // 动画帧间隔（毫秒）
+    "viewLen",          // 视口宽度（格子数），地图更大时镜头跟随勇者滚动
+    "viewWid",          // 视口高度（格子数）
+    "deadZoneLen",      // 镜头静止区域宽度（格子数）
+    "deadZoneWid",      // 镜头静止区域高度（格子数）
+    "spriteCacheSize",  // 各缩放级别精灵缓存的内存上限（MB）
+    //操作设置
+    "tickInterval",     // 逻辑步长（毫秒）
+    "moveInterval",     // 勇者走一格的时间（毫秒）
+    "undoDepth",        // 可撤销的步数
 };
 
 //Config构造函数实现
@@ -31,15 +42,26 @@ Config::Config()
     config["mapLen"] = "12";
     config["mapWid"] = "12";
     config["mapLayers"] = "3";
+    config["floorCacheSize"] = "256";   //未修改的楼层超过256MB时换出最久未访问的
     //渲染参数默认值
     config["blockSize"] = "64";         //格子大小64像素
     config["statusPanelWidth"] = "180"; //状态面板宽度180像素
+    config["animationInterval"] = "300"; //动画每300毫秒换一帧
+    config["viewLen"] = "12";           //视口最多显示12x12格
+    config["viewWid"] = "12";
+    config["deadZoneLen"] = "4";        //勇者在视口中央4x4格内移动时镜头不动
+    config["deadZoneWid"] = "4";
+    config["spriteCacheSize"] = "64";   //精灵缓存超过64MB时换出最久未用的缩放级别
+    //操作参数默认值
+    config["tickInterval"] = "16";      //逻辑每16毫秒推进一步
+    config["moveInterval"] = "120";     //按住方向键时每120毫秒走一格
+    config["undoDepth"] = "1000";       //最多撤销1000步
 }
 
-void Config::readConfig()
+void Config::readConfig(const QString& dir)
 {
     //QCoreApplication::applicationDirPath()返回程序可执行文件所在目录路径
-    QString filePath = QCoreApplication::applicationDirPath() + "/config.txt";
+    QString filePath = (dir.isEmpty() ? QCoreApplication::applicationDirPath() : dir) + "/config.txt";
     QFile file(filePath);
 
     //打开文件读取，同时处理读取失败
@@ -0,0 +1,42 @@
+//====================
+//游戏配置管理
+//====================
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QMap>
+//Config类用于读取和存储游戏设置
+class Config
+{
+public:
+    Config();
+    //从dir目录读取config.txt，dir为空时使用程序所在目录
+    void readConfig(const QString& dir = QString());
+    QMap<QString, QString> config;
+    
+    //重载[]运算符，方便访问配置项
+    QString& operator[](const QString& key)
+    {
+        return config[key];
+    }
+    
+    int getInt(const QString& key) const
+    {
+        return config.value(key).toInt();
+    }
+    
+    //常用渲染参数的快捷方法
+    int getBlockSize() const { return getInt("blockSize"); }
+    int getStatusPanelWidth() const { return getInt("statusPanelWidth"); }
+    int getAnimationInterval() const { return getInt("animationInterval"); }
+    int getViewLen() const { return getInt("viewLen"); }
+    int getViewWid() const { return getInt("viewWid"); }
+    int getDeadZoneLen() const { return getInt("deadZoneLen"); }
+    int getDeadZoneWid() const { return getInt("deadZoneWid"); }
+    int getSpriteCacheSize() const { return getInt("spriteCacheSize"); }
+    int getTickInterval() const { return getInt("tickInterval"); }
+    int getMoveInterval() const { return getInt("moveInterval"); }
+    int getUndoDepth() const { return getInt("undoDepth"); }
+    int getFloorCacheSize() const { return getInt("floorCacheSize"); }
+    bool getDrawGridBorder() const { return config.value("drawGridBorder") == "1"; }
+};
@@ -1,4 +1,5 @@
 #include "DataManager.h"
+#include "Zobrist.h"
 #include <QFile>
 #include <QTextStream>
 #include <QDebug>
@@ -6,6 +7,8 @@
 #include <QCoreApplication>
 #include <memory>
 #include <QStringList>
+#include <limits>
+#include <utility>
 
 static QStringList EntityType = 
 {
@@ -20,105 +23,186 @@ static QStringList EntityType =
     "STAIR"
 };
 
-void Data::LoadMap(int mapLen, int mapWid, int mapLayers)
+Data::Data(int mapLen, int mapWid, int mapLayers, const QString& rootDir, bool allowBinary)
+    : map(mapLen, mapWid, mapLayers)
 {
-    //遍历所有层数
-    for (int layer = 0; layer < mapLayers; ++layer) 
+    setRootDir(rootDir);
+    //发布用的二进制塔文件存在时直接映射，否则解析文本实体；
+    //注册表冻结后，楼层加载时直接把实体ID转换为句柄
+    QString towerPath = getTowerPath();
+    //塔文件的内容哈希在文件头中；文本塔在后台线程中按地图文件的原始字节计算，不解析楼层，
+    //启动时间只取决于预加载的楼层
+    if (allowBinary && QFile::exists(towerPath))
+        LoadTower(towerPath);
+    else
     {
-        //拼接地图文件路径，关联路径，通过操作file来操作文件
-        QDir appDirPath(QCoreApplication::applicationDirPath());
-        QString filePath = appDirPath.filePath(QString("gamedata/map/map%1.txt").arg(layer));
-        QFile file(filePath);
-
-        //打开文件读取，同时处理读取失败
-        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-            throw QString("无法打开地图文件:" + filePath);
-
-        //读取文件内容到in流
-        QTextStream in(&file);
-        QString line;
-        int row = 0;
-        //分区标记
-        //0:未开始,1:entity部分,2: floor部分
-        int section = 0;
-        int state = 0;   //计数已读取的部分
-        //一直读到文件结束
-        while (!in.atEnd()) 
+        LoadEntity();
+        const quint64 entities = hashEntities();
+        QStringList mapPaths;
+        for (int layer = 0; layer < mapLayers; ++layer)
+            mapPaths.append(getMapPath(layer));
+        std::atomic<bool>* cancelled = &hashCancelled;
+        contentHashTask = std::async(std::launch::async, [entities, mapPaths, cancelled]()
         {
-            line = in.readLine();
-            if (line.isEmpty()) continue;
-
-            //检查类型标志
-            if (line == "entity")
-            {
-                ++state;
-                section = 1;
-                row = 0;
-                continue;
-            } else if (line == "floor")
+            quint64 hash = entities;
+            for (int layer = 0; layer < mapPaths.size() && !*cancelled; ++layer)
             {
-                ++state;
-                section = 2;
-                row = 0;
-                continue;
+                QFile file(mapPaths[layer]);
+                QByteArray bytes = file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+                hash = mix64(hash ^ mix64(quint64(layer) + 0x9e3779b97f4a7c15ULL) ^ hashBytes(bytes.constData(), bytes.size()));
             }
+            return hash;
+        }).share();
+    }
 
-            //entity部分
-            if (section == 1)
-            { 
-                //分割行数据
-                QStringList ids = line.split(" ", Qt::SkipEmptyParts);
+    //楼层在首次访问时加载，启动时只加载前几层
+    spatialIndex.resize(mapLayers);
+    layerDeltaCount.resize(mapLayers);
+    map.loader = [this](int layer) { loadFloor(layer); };
+    for (int layer = 0; layer < qMin(PRELOAD_FLOORS, mapLayers); ++layer)
+        loadFloor(layer);
+}
 
-                //检验数据合法性
-                if (row >= mapWid)
-                    throw QString("地图文件%1的entity部分行数超过配置:%2行").arg(filePath).arg(mapWid);
-                if (ids.size() != mapLen)
-                    throw QString("地图文件%1的entity部分第%2行列数不符合预期:%3列").arg(filePath).arg(row + 1).arg(ids.size());
+Data::~Data()
+{
+    //后台哈希任务读完当前文件即退出，成员析构时等待它结束
+    hashCancelled = true;
+}
 
-                //存储entityId
-                for (int col = 0; col < mapLen; ++col)
-                {
-                    map.map[layer].floor[row][col].entityId = ids[col];
-                }
-                ++row;
-            }// floor部分
-            else if (section == 2)
-            {
-                //分割行数据
-                QStringList ids = line.split(" ", Qt::SkipEmptyParts);
+QString Data::getMapPath(int layer) const
+{
+    return QDir(rootDir).filePath(QString("gamedata/map/map%1.txt").arg(layer));
+}
 
-                //检验数据合法性
-                if (row >= mapWid)
-                    throw QString("地图文件%1的floor部分行数超过配置:%2行").arg(filePath).arg(mapWid);
-                if (ids.size() != mapLen)
-                    throw QString("地图文件%1的floor部分第%2行列数不符合预期:%3列").arg(filePath).arg(row + 1).arg(ids.size());
+quint64 Data::getContentHash() const
+{
+    return contentHashTask.valid() ? contentHashTask.get() : contentHash;
+}
 
-                //存储floorId到Block中
-                for (int col = 0; col < mapLen; ++col)
-                {
-                    map.map[layer].floor[row][col].floorId = ids[col].toInt();
-                }
-                ++row;
+QString Data::getTowerPath() const
+{
+    return QDir(rootDir).filePath("gamedata/tower.bin");
+}
+
+std::shared_ptr<Entity> Data::createEntity(EntityKind kind)
+{
+    switch (kind)
+    {
+    case EntityKind::Air:       return std::make_shared<Air>();
+    case EntityKind::HeroData:  return std::make_shared<HeroData>();
+    case EntityKind::Wall:      return std::make_shared<Wall>();
+    case EntityKind::Door:      return std::make_shared<Door>();
+    case EntityKind::Item:      return std::make_shared<Item>();
+    case EntityKind::Monster:   return std::make_shared<Monster>();
+    case EntityKind::NPC:       return std::make_shared<NPC>();
+    case EntityKind::Merchant:  return std::make_shared<Merchant>();
+    case EntityKind::Stair:     return std::make_shared<Stair>();
+    default:                    return nullptr;
+    }
+}
+
+void Data::setRootDir(const QString& dir)
+{
+    rootDir = dir.isEmpty() ? QCoreApplication::applicationDirPath() : dir;
+}
+
+void Data::readFloorText(int layer, Floor& floor)
+{
+    const int mapLen = map.len;
+    const int mapWid = map.wid;
+    //拼接地图文件路径，通过操作file来操作文件
+    QString filePath = getMapPath(layer);
+    QFile file(filePath);
+
+    //打开文件读取，同时处理读取失败
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        throw QString("无法打开地图文件:" + filePath);
+
+    //读取文件内容到in流
+    QTextStream in(&file);
+    QString line;
+    int row = 0;
+    //分区标记
+    //0:未开始,1:entity部分,2: floor部分
+    int section = 0;
+    int state = 0;   //计数已读取的部分
+    //一直读到文件结束
+    while (!in.atEnd()) 
+    {
+        line = in.readLine();
+        if (line.isEmpty()) continue;
+
+        //检查类型标志
+        if (line == "entity")
+        {
+            ++state;
+            section = 1;
+            row = 0;
+            continue;
+        } else if (line == "floor")
+        {
+            ++state;
+            section = 2;
+            row = 0;
+            continue;
+        }
+
+        //entity部分
+        if (section == 1)
+        { 
+            //分割行数据
+            QStringList ids = line.split(" ", Qt::SkipEmptyParts);
+
+            //检验数据合法性
+            //地图文件的第row行对应x=row，第col列对应y=col
+            if (row >= mapLen)
+                throw QString("地图文件%1的entity部分行数超过配置:%2行").arg(filePath).arg(mapLen);
+            if (ids.size() != mapWid)
+                throw QString("地图文件%1的entity部分第%2行列数不符合预期:%3列").arg(filePath).arg(row + 1).arg(ids.size());
+
+            //将entityId转换为句柄存储
+            for (int col = 0; col < mapWid; ++col)
+            {
+                floor.getBlock(row, col).entity = getHandle(ids[col]);
             }
-            else
+            ++row;
+        }// floor部分
+        else if (section == 2)
+        {
+            //分割行数据
+            QStringList ids = line.split(" ", Qt::SkipEmptyParts);
+
+            //检验数据合法性
+            if (row >= mapLen)
+                throw QString("地图文件%1的floor部分行数超过配置:%2行").arg(filePath).arg(mapLen);
+            if (ids.size() != mapWid)
+                throw QString("地图文件%1的floor部分第%2行列数不符合预期:%3列").arg(filePath).arg(row + 1).arg(ids.size());
+
+            //存储floorId到Block中
+            for (int col = 0; col < mapWid; ++col)
             {
-                throw QString("地图文件%1的第%2行类型不明:%3").arg(filePath).arg(row + 1).arg(line);
+                floor.getBlock(row, col).floorId = static_cast<quint16>(ids[col].toUInt());
             }
+            ++row;
+        }
+        else
+        {
+            throw QString("地图文件%1的第%2行类型不明:%3").arg(filePath).arg(row + 1).arg(line);
         }
+    }
 
-        // 检查是否读取了完整的entity和floor部分
-        if (state != 2)
-            throw QString("地图文件%1的结构错误").arg(filePath);
+    // 检查是否读取了完整的entity和floor部分
+    if (state != 2)
+        throw QString("地图文件%1的结构错误").arg(filePath);
 
-        // 关闭文件
-        file.close();
-    }
+    // 关闭文件
+    file.close();
 }
 
 void Data::LoadEntity()
 {
-    //获取应用程序目录
-    QDir appDirPath(QCoreApplication::applicationDirPath());
+    //获取gamedata所在目录
+    QDir appDirPath(rootDir);
 
     // 遍历所有实体类型
     for (const QString& type : EntityType)
@@ -160,29 +244,11 @@ void Data::LoadEntity()
                 QString entityId = parts[0];
                 QString entityType = parts[1];
 
-                // 根据实体类型创建对象
-                if (entityType == "AIR")
-                    entityObj = std::make_shared<Air>();
-                else if (entityType == "HERODATA")
-                    entityObj = std::make_shared<HeroData>();
-                else if (entityType == "WALL")
-                    entityObj = std::make_shared<Wall>();
-                else if (entityType == "DOOR")
-                    entityObj = std::make_shared<Door>();
-                else if (entityType == "ITEM")
-                    entityObj = std::make_shared<Item>();
-                else if (entityType == "MONSTER")
-                    entityObj = std::make_shared<Monster>();
-                else if (entityType == "NPC")
-                    entityObj = std::make_shared<NPC>();
-                else if (entityType == "MERCHANT")
-                    entityObj = std::make_shared<Merchant>();
-                else if (entityType == "STAIR")
-                {
-                    entityObj = std::make_shared<Stair>();
-                }
-                else
+                // 根据实体类型创建对象，类型名在EntityType中的下标即EntityKind
+                int kindIndex = EntityType.indexOf(entityType);
+                if (kindIndex < 0)
                     throw QString("未知实体类型:" + entityType + " 行:" + line);
+                entityObj = createEntity(static_cast<EntityKind>(kindIndex));
                 entityObj->id = entityId;
             }
             else    //已读实体标识，解析属性
@@ -193,36 +259,51 @@ void Data::LoadEntity()
                 QString key = keyValue[0];
                 QString value = keyValue[1];
                 // 根据实体类型设置属性
-                if (entityObj->type == "HERODATA")
+                switch (entityObj->kind)
+                {
+                case EntityKind::HeroData:
                 {
-                    HeroData* hero = dynamic_cast<HeroData*>(entityObj.get());
-                    if (hero)
-                    {
-                        if (key == "posx") hero->posx = value.toInt();
-                        else if (key == "posy") hero->posy = value.toInt();
-                        else if (key == "face") hero->face = value.toInt();
-                        else if (key == "hp") hero->hp = value.toInt();
-                        else if (key == "atk") hero->atk = value.toInt();
-                        else if (key == "def") hero->def = value.toInt();
-                        else if (key == "gold") hero->gold = value.toInt();
-                        else if (key == "yellow_key") hero->yellow_key = value.toInt();
-                        else if (key == "blue_key") hero->blue_key = value.toInt();
-                        else if (key == "red_key") hero->red_key = value.toInt();
-                    }
+                    HeroData* hero = static_cast<HeroData*>(entityObj.get());
+                    if (key == "posx") hero->posx = value.toInt();
+                    else if (key == "posy") hero->posy = value.toInt();
+                    else if (key == "face") hero->face = value.toInt();
+                    else if (key == "hp") hero->hp = value.toInt();
+                    else if (key == "atk") hero->atk = value.toInt();
+                    else if (key == "def") hero->def = value.toInt();
+                    else if (key == "gold") hero->gold = value.toInt();
+                    else if (key == "yellow_key") hero->yellow_key = value.toInt();
+                    else if (key == "blue_key") hero->blue_key = value.toInt();
+                    else if (key == "red_key") hero->red_key = value.toInt();
+                    break;
                 }
-                else if (entityObj->type == "MONSTER")
+                case EntityKind::Monster:
                 {
                     Monster* monster = static_cast<Monster*>(entityObj.get());
-                    if (monster)
-                    {
-                        if (key == "hp") monster->hp = value.toInt();
-                        else if (key == "atk") monster->atk = value.toInt();
-                        else if (key == "def") monster->def = value.toInt();
-                        else if (key == "gold") monster->gold = value.toInt();
-                        else if (key == "traitID") monster->traitID = value;
-                    }
+                    if (key == "hp") monster->hp = value.toInt();
+                    else if (key == "atk") monster->atk = value.toInt();
+                    else if (key == "def") monster->def = value.toInt();
+                    else if (key == "gold") monster->gold = value.toInt();
+                    else if (key == "traitID") monster->traitID = value;
+                    break;
+                }
+                case EntityKind::Item:
+                    //拾取效果，如 hp=200、yellow_key=1，属性名拼错时报错而不是忽略
+                    if (!static_cast<Item*>(entityObj.get())->effect.set(key, value.toInt()))
+                        throw QString("属性格式错误:" + filePath + " 行:" + line);
+                    break;
+                case EntityKind::Door:
+                    //开门消耗，如 yellow_key=1，属性名拼错时报错而不是忽略
+                    if (!static_cast<Door*>(entityObj.get())->cost.set(key, value.toInt()))
+                        throw QString("属性格式错误:" + filePath + " 行:" + line);
+                    break;
+                case EntityKind::Stair:
+                    //楼层变化，1上楼，-1下楼
+                    if (key == "floor") static_cast<Stair*>(entityObj.get())->floorOffset = value.toInt();
+                    break;
+                default:
+                    //拓展实体
+                    break;
                 }
-                //拓展实体
             }
         }
         //保存文件最后的实体
@@ -232,11 +313,351 @@ void Data::LoadEntity()
         // 关闭文件
         file.close();
     }
+
+    freezeRegistry();
+}
+
+//编译实体的效果表项：物品为拾取效果，门为开门消耗
+static StatDelta compileEffect(const Entity& entity)
+{
+    StatDelta delta;
+    if (entity.kind == EntityKind::Item)
+        delta = static_cast<const Item&>(entity).effect;
+    else if (entity.kind == EntityKind::Door)
+        delta = static_cast<const Door&>(entity).cost;
+    else
+        return delta;
+    //效果必须在实体文件中声明：没有效果的物品拾取后什么也不发生，开门消耗为零的门会被免费打开
+    if (delta.isZero())
+        throw QString("实体未声明%1:%2").arg(entity.kind == EntityKind::Door ? QString("开门消耗") : QString("拾取效果"), entity.id);
+    return delta;
+}
+
+void Data::freezeRegistry()
+{
+    handleTable.clear();
+    handleIds.clear();
+    handleIndex.clear();
+    kindTable.clear();
+    effectTable.clear();
+
+    //句柄0固定为air，未定义air时补一个默认实体
+    std::shared_ptr<Entity> air = entity.value("air", nullptr);
+    if (!air)
+    {
+        air = std::make_shared<Air>();
+        air->id = "air";
+        entity["air"] = air;
+    }
+    air->handle = AIR_HANDLE;
+    handleTable.append(air);
+    handleIds.append(air->id);
+    handleIndex.insert(air->id, AIR_HANDLE);
+    kindTable.append(EntityKind::Air);
+    effectTable.append(StatDelta());
+
+    //其余实体按ID顺序编号，保证每次加载得到相同的句柄
+    for (auto it = entity.cbegin(); it != entity.cend(); ++it)
+    {
+        if (it.key() == "air")
+            continue;
+        if (handleTable.size() > std::numeric_limits<EntityHandle>::max())
+            throw QString("实体数量超过句柄上限:%1").arg(std::numeric_limits<EntityHandle>::max());
+        EntityHandle handle = static_cast<EntityHandle>(handleTable.size());
+        it.value()->handle = handle;
+        handleTable.append(it.value());
+        handleIds.append(it.key());
+        handleIndex.insert(it.key(), handle);
+        kindTable.append(it.value()->kind);
+        effectTable.append(compileEffect(*it.value()));
+
+        //楼梯必须声明楼层变化
+        if (it.value()->kind == EntityKind::Stair && static_cast<const Stair&>(*it.value()).floorOffset == 0)
+            throw QString("楼梯未声明楼层变化:" + it.key());
+    }
+
+    hero = std::dynamic_pointer_cast<HeroData>(entity.value("hero", nullptr));
 }
 
-std::shared_ptr<HeroData> Data::getHeroData()
+const std::shared_ptr<Entity>& Data::getEntity(EntityHandle handle) const
 {
-    return std::dynamic_pointer_cast<HeroData>(entity.value("hero", nullptr));
+    static const std::shared_ptr<Entity> none;
+    if (handle >= handleTable.size())
+        return none;
+    return handleTable[handle];
+}
+
+EntityHandle Data::getHandle(const QString& id)
+{
+    //空ID与air等价
+    if (id.isEmpty())
+        return AIR_HANDLE;
+
+    auto it = handleIndex.constFind(id);
+    if (it != handleIndex.constEnd())
+        return it.value();
+
+    //地图中引用了未定义的实体，登记为占位句柄（不可通行，仅按ID绘制材质）
+    if (handleTable.size() > std::numeric_limits<EntityHandle>::max())
+        throw QString("实体数量超过句柄上限:%1").arg(std::numeric_limits<EntityHandle>::max());
+    EntityHandle handle = static_cast<EntityHandle>(handleTable.size());
+    handleTable.append(nullptr);
+    handleIds.append(id);
+    handleIndex.insert(id, handle);
+    kindTable.append(EntityKind::Undefined);
+    effectTable.append(StatDelta());
+    return handle;
+}
+
+EntityKind Data::getKind(EntityHandle handle) const
+{
+    if (handle >= kindTable.size())
+        return EntityKind::Undefined;
+    return kindTable[handle];
+}
+
+const StatDelta& Data::getEffect(EntityHandle handle) const
+{
+    static const StatDelta none;
+    if (handle >= effectTable.size())
+        return none;
+    return effectTable[handle];
+}
+
+const QString& Data::getEntityId(EntityHandle handle) const
+{
+    static const QString none;
+    if (handle >= handleIds.size())
+        return none;
+    return handleIds[handle];
+}
+
+int Data::getStairOffset(EntityHandle handle) const
+{
+    if (getKind(handle) != EntityKind::Stair)
+        return 0;
+    return static_cast<const Stair*>(handleTable[handle].get())->floorOffset;
+}
+
+bool Data::isIndexed(EntityKind kind)
+{
+    switch (kind)
+    {
+    case EntityKind::Door:
+    case EntityKind::Item:
+    case EntityKind::Monster:
+    case EntityKind::NPC:
+    case EntityKind::Merchant:
+    case EntityKind::Stair:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Data::indexFloor(int layer)
+{
+    const Floor& floor = map.map[layer];
+    for (int y = 0; y < map.wid; ++y)
+    {
+        const Block* row = floor.row(y);
+        for (int x = 0; x < map.len; ++x)
+            indexInsert(row[x].entity, x, y, layer);
+    }
+}
+
+void Data::readFloor(int layer, Floor& floor)
+{
+    if (towerPlane)
+        readFloorBinary(layer, floor);
+    else
+        readFloorText(layer, floor);
+}
+
+void Data::loadFloor(int layer)
+{
+    Floor& floor = map.map[layer];
+    if (floor.isLoaded())
+        return;
+    floor.allocate();
+    try
+    {
+        readFloor(layer, floor);
+    }
+    catch (...)
+    {
+        floor.release();
+        throw;
+    }
+    indexFloor(layer);
+    ++residentFloors;
+}
+
+void Data::evictFloor(int layer)
+{
+    //只换出没有变化的楼层，重新加载后与换出前相同；版本号保留，重新加载时继续递增
+    Floor& floor = map.map[layer];
+    if (!floor.isLoaded() || layerDeltaCount[layer] != 0)
+        return;
+    floor.release();
+    LayerIndex& index = spatialIndex[layer];
+    index.byHandle.clear();
+    for (QVector<QPoint>& points : index.byKind)
+        points = QVector<QPoint>();
+    index.slots.clear();
+    --residentFloors;
+}
+
+void Data::enterFloor(int layer)
+{
+    if (layer < 0 || layer >= map.layers)
+        return;
+    map.getFloor(layer);
+    if (layer + 1 < map.layers && !map.map[layer + 1].isLoaded())
+    {
+        loadFloor(layer + 1);
+        map.map[layer + 1].lastUse = map.useClock;
+    }
+
+    //超出内存上限时换出最久未访问的未修改楼层，当前层与预读的上一层除外
+    const qint64 floorBytes = qint64(map.len) * map.wid * sizeof(Block);
+    while (qint64(residentFloors) * floorBytes > floorBudget)
+    {
+        int victim = -1;
+        for (int other = 0; other < map.layers; ++other)
+        {
+            const Floor& floor = map.map[other];
+            if (other == layer || other == layer + 1 || !floor.isLoaded() || layerDeltaCount[other] != 0)
+                continue;
+            if (victim < 0 || floor.lastUse < map.map[victim].lastUse)
+                victim = other;
+        }
+        if (victim < 0)
+            break;
+        evictFloor(victim);
+    }
+}
+
+const Floor& Data::residentFloor(int layer) const
+{
+    return const_cast<Data*>(this)->map.getFloor(layer);
+}
+
+quint64 Data::hashEntities() const
+{
+    //实体定义（含勇者初始状态）按句柄顺序序列化后整体哈希，占位句柄不计入
+    QByteArray entities;
+    for (int handle = 0; handle < handleTable.size(); ++handle)
+    {
+        if (handleTable[handle])
+            entities += serializeEntity(handle);
+    }
+    return hashBytes(entities.constData(), entities.size());
+}
+
+quint64 Data::stateHash() const
+{
+    return hero ? tileHash ^ zobristHero(*hero) : tileHash;
+}
+
+void Data::indexInsert(EntityHandle handle, int x, int y, int layer)
+{
+    EntityKind kind = getKind(handle);
+    if (!isIndexed(kind))
+        return;
+    LayerIndex& index = spatialIndex[layer];
+    QVector<QPoint>& handlePoints = index.byHandle[handle];
+    QVector<QPoint>& kindPoints = index.byKind[static_cast<int>(kind)];
+    index.slots.insert(LayerIndex::pointKey(QPoint(x, y)), {int(kindPoints.size()), int(handlePoints.size())});
+    handlePoints.append(QPoint(x, y));
+    kindPoints.append(QPoint(x, y));
+    ++index.revision[static_cast<int>(kind)];
+}
+
+//删除列表中下标为slot的坐标：与末尾交换后删除，不保持顺序，被移动的坐标通过slotOf更新下标
+template <typename SlotOf>
+static void removeSlot(QVector<QPoint>& points, int slot, SlotOf slotOf)
+{
+    if (slot < points.size() - 1)
+    {
+        points[slot] = points.last();
+        slotOf(points[slot]) = slot;
+    }
+    points.removeLast();
+}
+
+void Data::indexRemove(EntityHandle handle, int x, int y, int layer)
+{
+    EntityKind kind = getKind(handle);
+    if (!isIndexed(kind))
+        return;
+    LayerIndex& index = spatialIndex[layer];
+    auto slot = index.slots.find(LayerIndex::pointKey(QPoint(x, y)));
+    if (slot == index.slots.end())
+        return;
+    const LayerIndex::Slot removed = slot.value();
+    index.slots.erase(slot);
+    auto it = index.byHandle.find(handle);
+    if (it != index.byHandle.end())
+    {
+        removeSlot(it.value(), removed.handleSlot,
+                   [&index](const QPoint& point) -> int& { return index.slots[LayerIndex::pointKey(point)].handleSlot; });
+        if (it.value().isEmpty())
+            index.byHandle.erase(it);
+    }
+    removeSlot(index.byKind[static_cast<int>(kind)], removed.kindSlot,
+               [&index](const QPoint& point) -> int& { return index.slots[LayerIndex::pointKey(point)].kindSlot; });
+    ++index.revision[static_cast<int>(kind)];
+}
+
+const LayerIndex& Data::getLayerIndex(int layer) const
+{
+    static const LayerIndex none;
+    if (layer < 0 || layer >= spatialIndex.size())
+        return none;
+    residentFloor(layer);
+    return spatialIndex[layer];
+}
+
+quint32 Data::getRevision(EntityKind kind, int layer) const
+{
+    return getLayerIndex(layer).revision[static_cast<int>(kind)];
+}
+
+const QVector<QPoint>& Data::findAll(EntityHandle handle, int layer) const
+{
+    static const QVector<QPoint> none;
+    if (layer < 0 || layer >= spatialIndex.size())
+        return none;
+    residentFloor(layer);
+    auto it = spatialIndex[layer].byHandle.constFind(handle);
+    return it == spatialIndex[layer].byHandle.constEnd() ? none : it.value();
+}
+
+const QVector<QPoint>& Data::findAll(EntityKind kind, int layer) const
+{
+    static const QVector<QPoint> none;
+    if (layer < 0 || layer >= spatialIndex.size() || kind >= EntityKind::Count)
+        return none;
+    residentFloor(layer);
+    return spatialIndex[layer].byKind[static_cast<int>(kind)];
+}
+
+QPoint Data::findFirst(EntityHandle handle, int layer) const
+{
+    const QVector<QPoint>& points = findAll(handle, layer);
+    return points.isEmpty() ? QPoint(-1, -1) : points.first();
+}
+
+QPoint Data::findStair(int layer, int floorOffset) const
+{
+    //每层楼梯数量很少，遍历该层楼梯即可
+    for (const QPoint& pos : findAll(EntityKind::Stair, layer))
+    {
+        if (getStairOffset(residentFloor(layer).getBlock(pos.x(), pos.y()).entity) == floorOffset)
+            return pos;
+    }
+    return QPoint(-1, -1);
 }
 
 std::shared_ptr<Entity> Data::getXY(int x, int y,int layer)
@@ -245,18 +666,90 @@ std::shared_ptr<Entity> Data::getXY(int x, int y,int layer)
     if (x < 0 || x >= map.len || y < 0 || y >= map.wid || layer < 0 || layer >= map.map.size())
         return nullptr;
     // 默认获取第layer层坐标X,Y的实体
-    QString entityId = map.map[layer].floor[x][y].entityId;
-    return entity.value(entityId, nullptr);
+    return getEntity(map.getFloor(layer).getBlock(x, y).entity);
 }
 
 void Data::setEntity(const QString& id, int x, int y, int layer)
+{
+    setEntity(getHandle(id), x, y, layer);
+}
+
+void Data::setEntity(EntityHandle handle, int x, int y, int layer)
 {
     if (x < 0 || x >= map.len || y < 0 || y >= map.wid || layer < 0 || layer >= map.map.size())
         return;
-    map.map[layer].floor[x][y].entityId = id;
+    Block& block = map.getFloor(layer).getBlock(x, y);
+    if (block.entity == handle)
+        return;
+    //同步更新位置索引、地图哈希与变化记录
+    indexRemove(block.entity, x, y, layer);
+    tileHash ^= zobristTile(layer, x, y, block.entity) ^ zobristTile(layer, x, y, handle);
+    quint32 key = tileKey(x, y, layer);
+    auto pristine = pristineTiles.constFind(key);
+    if (pristine == pristineTiles.constEnd())
+    {
+        pristineTiles.insert(key, block.entity);
+        deltaTiles.insert(key, handle);
+        ++layerDeltaCount[layer];
+    }
+    else if (pristine.value() == handle)
+    {
+        pristineTiles.remove(key);
+        deltaTiles.remove(key);
+        --layerDeltaCount[layer];
+    }
+    else
+        deltaTiles.insert(key, handle);
+    block.entity = handle;
+    indexInsert(handle, x, y, layer);
+}
+
+void Data::tileCoord(quint32 key, int& x, int& y, int& layer) const
+{
+    x = key % map.len;
+    y = (key / map.len) % map.wid;
+    layer = key / (map.len * map.wid);
+}
+
+TowerDelta Data::captureDelta() const
+{
+    TowerDelta delta;
+    delta.tiles = deltaTiles;
+    if (hero)
+        delta.hero = *hero;
+    return delta;
+}
+
+void Data::restoreDelta(const TowerDelta& delta, QVector<TileChange>* changes)
+{
+    auto restoreTile = [&](quint32 key, EntityHandle handle)
+    {
+        int x, y, layer;
+        tileCoord(key, x, y, layer);
+        EntityHandle before = map.getFloor(layer).getBlock(x, y).entity;
+        if (before == handle)
+            return;
+        setEntity(handle, x, y, layer);
+        if (changes)
+            changes->append({layer, x, y, before, handle});
+    };
+
+    //setEntity会修改变化记录，遍历前先取得一份（隐式共享）副本
+    const QHash<quint32, EntityHandle> current = deltaTiles;
+    const QHash<quint32, EntityHandle> pristine = pristineTiles;
+    for (auto it = current.cbegin(); it != current.cend(); ++it)
+    {
+        if (!delta.tiles.contains(it.key()))
+            restoreTile(it.key(), pristine.value(it.key()));
+    }
+    for (auto it = delta.tiles.cbegin(); it != delta.tiles.cend(); ++it)
+        restoreTile(it.key(), it.value());
+
+    if (hero)
+        static_cast<HeroState&>(*hero) = delta.hero;
 }
 
 void Data::removeEntity(int x, int y, int layer)
 {
-    setEntity("air", x, y, layer);
+    setEntity(AIR_HANDLE, x, y, layer);
 }
\ No newline at end of file
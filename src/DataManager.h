@@ -4,45 +4,236 @@
 #pragma once
 #include <QObject>
 #include <QMap>
+#include <QHash>
 #include <QVector>
+#include <QPoint>
 #include <memory>
+#include <atomic>
+#include <future>
 #include "Entity.h"
 #include "MapLoader.h"
+#include "ChangeSet.h"
 
 //====================
 //获取地图数据
 //Data.map
-//获取某层数据
+//获取某层数据（未加载的楼层在访问时加载）
 //Data.map.getFloor(int layer)
 //获取某格数据
 //Data.map.getFloor(int layer).getBlock(int x,int y)
 //获取某格实体数据
-//Data.getEntity(Data.map.getFloor(int layer).getBlock(int x,int y).entityId)
+//Data.getEntity(Data.map.getFloor(int layer).getBlock(int x,int y).entity)
+//查询某层中特定实体/种类的全部坐标
+//Data.findAll(EntityHandle handle,int layer) / Data.findAll(EntityKind kind,int layer)
 //====================
 
-class Data
+//单层的特殊格子位置索引（门、物品、怪物、NPC、商人、楼梯），
+//空地与墙数量多且无需查询，不进入索引
+class LayerIndex
 {
 public:
-    Data(int mapLen,int mapWid,int mapLayers) : map(mapLen,mapWid,mapLayers)
+    QHash<EntityHandle, QVector<QPoint>> byHandle;
+    QVector<QPoint> byKind[static_cast<int>(EntityKind::Count)];
+    //每个种类的格子集合变化时递增，用于判断缓存是否失效
+    quint32 revision[static_cast<int>(EntityKind::Count)] = {};
+
+    //每个已索引格子在byKind与byHandle列表中的下标，删除时直接与末尾交换，不需要查找
+    struct Slot
+    {
+        int kindSlot;
+        int handleSlot;
+    };
+    QHash<quint64, Slot> slots;
+    static quint64 pointKey(const QPoint& point)
     {
-        LoadMap(mapLen,mapWid,mapLayers);
-        LoadEntity();
+        return (quint64(quint32(point.y())) << 32) | quint32(point.x());
     }
+};
+
+//相对加载时的塔的变化：只记录与初始状态不同的格子，内存与游戏进度成正比
+struct TowerDelta
+{
+    //全塔格子下标（见Data::tileKey）-> 当前句柄
+    QHash<quint32, EntityHandle> tiles;
+    HeroState hero;
+};
 
-    void LoadMap(int mapLen,int mapWid,int mapLayers);
+class QFile;
+
+class Data
+{
+public:
+    //rootDir为gamedata所在目录，为空时使用程序所在目录
+    //allowBinary为true且存在gamedata/tower.bin时加载二进制塔文件，否则解析文本
+    //构造时只加载实体与前PRELOAD_FLOORS层，其余楼层在首次访问时加载
+    Data(int mapLen,int mapWid,int mapLayers,const QString& rootDir = QString(),bool allowBinary = true);
+    ~Data();
 
     void LoadEntity();
 
-    std::shared_ptr<Entity> getEntity(QString id){return entity[id];}
+    //打开二进制塔文件（格式见TowerFile.cpp）：读取实体表并保持文件映射，楼层加载时直接拷贝格子
+    void LoadTower(const QString& filePath);
+    //保存二进制塔文件，未加载的楼层从来源读取，不会常驻
+    void SaveTower(const QString& filePath);
+
+    //当前地图与实体表按塔文件格式序列化
+    QByteArray serializeTower();
+
+    //二进制塔文件的默认路径：gamedata/tower.bin
+    QString getTowerPath() const;
+
+    //第layer层的文本地图路径：gamedata/map/map<layer>.txt
+    QString getMapPath(int layer) const;
+
+    //加载时塔内容（已定义实体、初始勇者与各层地图文件）的哈希，与从文本还是二进制加载、楼层加载顺序无关。
+    //文本塔在构造时启动后台线程读取地图文件的原始字节计算，不解析楼层，查询时若尚未完成则等待；
+    //塔文件由mota-pack在打包时写入文件头
+    quint64 getContentHash() const;
+
+    //构造时预先加载的楼层数
+    static const int PRELOAD_FLOORS = 2;
+    //进入楼层：加载该层并预读上一层，再按内存上限换出最久未访问的未修改楼层。
+    //有修改的楼层总是驻留；换出时不能持有其他楼层的Floor引用
+    void enterFloor(int layer);
+    //驻留楼层格子的内存上限（字节）
+    void setFloorBudget(qint64 bytes) {floorBudget = bytes;}
+    int residentFloorCount() const {return residentFloors;}
+
+    //根据句柄获取实体，数组下标访问；地图中出现但未定义的ID返回nullptr
+    const std::shared_ptr<Entity>& getEntity(EntityHandle handle) const;
+
+    //根据ID获取实体，查找失败时不会插入空条目
+    std::shared_ptr<Entity> getEntity(const QString& id) const {return entity.value(id, nullptr);}
+
+    //ID转句柄，未定义的ID会登记为无实体的占位句柄
+    EntityHandle getHandle(const QString& id);
+
+    //句柄转ID
+    const QString& getEntityId(EntityHandle handle) const;
+
+    //句柄对应的实体种类，占位句柄为EntityKind::Undefined
+    EntityKind getKind(EntityHandle handle) const;
+
+    //句柄对应的效果表项：物品的拾取效果、门的开门消耗，其余实体为空
+    const StatDelta& getEffect(EntityHandle handle) const;
 
-    std::shared_ptr<HeroData> getHeroData();
+    //已登记的句柄数量
+    int handleCount() const {return handleTable.size();}
+
+    //楼梯句柄对应的楼层变化，非楼梯返回0
+    int getStairOffset(EntityHandle handle) const;
+
+    std::shared_ptr<HeroData> getHeroData() const {return hero;}
+
+    //第layer层中句柄为handle/种类为kind的全部坐标（仅索引特殊格子）
+    const QVector<QPoint>& findAll(EntityHandle handle, int layer) const;
+    const QVector<QPoint>& findAll(EntityKind kind, int layer) const;
+
+    //第layer层的完整位置索引
+    const LayerIndex& getLayerIndex(int layer) const;
+
+    //第layer层中种类为kind的格子集合的版本号
+    quint32 getRevision(EntityKind kind, int layer) const;
+
+    //第layer层中第一个句柄为handle的坐标，不存在时返回(-1,-1)
+    QPoint findFirst(EntityHandle handle, int layer) const;
+
+    //第layer层中第一个楼层变化为floorOffset的楼梯坐标，不存在时返回(-1,-1)
+    QPoint findStair(int layer, int floorOffset) const;
 
     std::shared_ptr<Entity> getXY(int x,int y,int layer);
 
     void setEntity(const QString& id, int x, int y, int layer);
+
+    void setEntity(EntityHandle handle, int x, int y, int layer);
     
     void removeEntity(int x, int y, int layer);
 
+    //地图相对加载时的Zobrist哈希：每个变化的格子贡献其初始与当前实体之差，
+    //由setEntity/removeEntity以O(1)增量维护，未加载（未修改）的楼层贡献为0
+    quint64 getTileHash() const {return tileHash;}
+
+    //地图与勇者状态的哈希，勇者部分为定长字段，查询时以常数时间合成
+    quint64 stateHash() const;
+
+    //gamedata所在目录
+    const QString& getRootDir() const {return rootDir;}
+
+    //当前状态相对加载时的变化，格子部分与内部记录隐式共享，常数时间
+    TowerDelta captureDelta() const;
+    //把地图与勇者恢复到delta记录的状态：先把delta中没有的已变化格子恢复为初始值，再写入delta中的格子
+    //耗时与当前和目标两份变化的大小成正比；changes不为空时追加每个被修改的格子
+    void restoreDelta(const TowerDelta& delta, QVector<TileChange>* changes = nullptr);
+    //已变化的格子数量
+    int deltaSize() const {return deltaTiles.size();}
+
+    //全塔格子下标与坐标的转换
+    quint32 tileKey(int x, int y, int layer) const {return (quint32(layer) * map.wid + y) * map.len + x;}
+    void tileCoord(quint32 key, int& x, int& y, int& layer) const;
+
     Map map;
     QMap<QString,std::shared_ptr<Entity>> entity;
+
+private:
+    void setRootDir(const QString& dir);
+
+    //按种类创建空实体
+    static std::shared_ptr<Entity> createEntity(EntityKind kind);
+    //一个句柄在塔文件实体表中的记录
+    QByteArray serializeEntity(EntityHandle handle) const;
+    //已定义实体的哈希，塔内容哈希的一部分
+    quint64 hashEntities() const;
+
+    //为全部已定义实体分配句柄，LoadEntity结束时调用
+    void freezeRegistry();
+
+    //楼层的加载与换出
+    void loadFloor(int layer);
+    void evictFloor(int layer);
+    //从文本地图或塔文件读取一层的初始格子到floor（floor已分配）
+    void readFloor(int layer, Floor& floor);
+    void readFloorText(int layer, Floor& floor);
+    void readFloorBinary(int layer, Floor& floor);
+    //const查询使用的楼层，未加载时先加载（加载不改变塔的内容）
+    const Floor& residentFloor(int layer) const;
+
+    //扫描一层建立位置索引，楼层加载后调用
+    void indexFloor(int layer);
+    //在索引中登记/注销一个格子
+    void indexInsert(EntityHandle handle, int x, int y, int layer);
+    void indexRemove(EntityHandle handle, int x, int y, int layer);
+    //该种类的格子是否进入索引
+    static bool isIndexed(EntityKind kind);
+
+    //句柄 -> 实体/ID
+    QVector<std::shared_ptr<Entity>> handleTable;
+    QVector<QString> handleIds;
+    //ID -> 句柄
+    QHash<QString, EntityHandle> handleIndex;
+    //句柄 -> 实体种类/效果，加载时编译的连续查找表
+    QVector<EntityKind> kindTable;
+    QVector<StatDelta> effectTable;
+    //gamedata所在目录
+    QString rootDir;
+    //每层的特殊格子位置索引
+    QVector<LayerIndex> spatialIndex;
+    //地图相对加载时的Zobrist哈希
+    quint64 tileHash = 0;
+    //加载时的塔内容哈希：塔文件直接读出，文本塔由后台任务计算
+    quint64 contentHash = 0;
+    std::shared_future<quint64> contentHashTask;
+    std::atomic<bool> hashCancelled{false};
+    //与加载时不同的格子：当前句柄及其初始句柄，由setEntity维护，格子变回初始值时移除
+    QHash<quint32, EntityHandle> deltaTiles;
+    QHash<quint32, EntityHandle> pristineTiles;
+    //每层变化的格子数，不为0的楼层不会被换出
+    QVector<int> layerDeltaCount;
+    //驻留楼层数与内存上限
+    int residentFloors = 0;
+    qint64 floorBudget = qint64(256) << 20;
+    //已映射的二进制塔文件及其格子平面，文本加载时为空
+    std::unique_ptr<QFile> towerFile;
+    const uchar* towerPlane = nullptr;
+    //勇者数据缓存，避免每次按ID查找并做类型转换
+    std::shared_ptr<HeroData> hero;
 };
\ No newline at end of file
@@ -7,14 +7,68 @@
 #include <QVariant>
 #include <QVector>
 
+// 实体句柄：实体注册表中的紧凑下标，地图格子与游戏逻辑通过句柄引用实体
+using EntityHandle = quint16;
+// 句柄0固定为air
+const EntityHandle AIR_HANDLE = 0;
+
+// 实体种类，顺序与实体文件的类型名列表一致
+enum class EntityKind : quint8
+{
+    Air,
+    HeroData,
+    Wall,
+    Door,
+    Item,
+    Monster,
+    NPC,
+    Merchant,
+    Stair,
+    Undefined,  // 地图中引用但未定义的实体
+    Count
+};
+
+// 属性变化量：物品的拾取效果、门的钥匙消耗
+struct StatDelta
+{
+    int hp = 0;
+    int atk = 0;
+    int def = 0;
+    int gold = 0;
+    int yellow_key = 0;
+    int blue_key = 0;
+    int red_key = 0;
+
+    //按属性名设置，未知属性名返回false
+    bool set(const QString& key, int value)
+    {
+        if (key == "hp") hp = value;
+        else if (key == "atk") atk = value;
+        else if (key == "def") def = value;
+        else if (key == "gold") gold = value;
+        else if (key == "yellow_key") yellow_key = value;
+        else if (key == "blue_key") blue_key = value;
+        else if (key == "red_key") red_key = value;
+        else return false;
+        return true;
+    }
+
+    bool isZero() const
+    {
+        return !hp && !atk && !def && !gold && !yellow_key && !blue_key && !red_key;
+    }
+};
+
 // 实体基类
 class Entity
 {
 public:
     virtual ~Entity() = default;
-    Entity(const QString &type) : type(type){}
+    Entity(EntityKind kind, const QString &type) : type(type), kind(kind){}
     QString id;
     QString type;
+    EntityKind kind;
+    EntityHandle handle = AIR_HANDLE;   // 注册表冻结时分配
 };
 
 //==============================
@@ -23,70 +77,97 @@ public:
 class Air : public Entity
 {
 public:
-    Air() : Entity("AIR"){}
+    Air() : Entity(EntityKind::Air, "AIR"){}
 };
 
-class HeroData : public Entity
+// 勇者的全部可变状态，可直接拷贝与比较
+struct HeroState
 {
-public:
     //pos
-    int posx;
-    int posy;
-    int face;   //0左1上2右3下
+    int posx = 0;
+    int posy = 0;
+    int face = 0;   //0左1上2右3下
     //statu
-    int hp;
-    int atk;
-    int def;
-    int gold;
-    int yellow_key;
-    int blue_key;
-    int red_key;
-    HeroData() : Entity("HERODATA"){}
+    int hp = 0;
+    int atk = 0;
+    int def = 0;
+    int gold = 0;
+    int yellow_key = 0;
+    int blue_key = 0;
+    int red_key = 0;
+
+    //叠加属性变化量，sign为-1时扣除
+    void apply(const StatDelta& delta, int sign = 1)
+    {
+        hp += sign * delta.hp;
+        atk += sign * delta.atk;
+        def += sign * delta.def;
+        gold += sign * delta.gold;
+        yellow_key += sign * delta.yellow_key;
+        blue_key += sign * delta.blue_key;
+        red_key += sign * delta.red_key;
+    }
+
+    //当前属性是否足够支付cost
+    bool canPay(const StatDelta& cost) const
+    {
+        return hp >= cost.hp && atk >= cost.atk && def >= cost.def && gold >= cost.gold
+            && yellow_key >= cost.yellow_key && blue_key >= cost.blue_key && red_key >= cost.red_key;
+    }
+};
+
+class HeroData : public Entity, public HeroState
+{
+public:
+    HeroData() : Entity(EntityKind::HeroData, "HERODATA"){}
 };
 
 class Wall : public Entity
 {
 public:
-    Wall() : Entity("WALL"){}
+    Wall() : Entity(EntityKind::Wall, "WALL"){}
 };
 
 class Door : public Entity
 {
 public:
-    Door() : Entity("DOOR"){}
+    StatDelta cost;     // 开门消耗
+    Door() : Entity(EntityKind::Door, "DOOR"){}
 };
 
 class Item : public Entity
 {
 public:
-    Item() : Entity("ITEM"){}
+    StatDelta effect;   // 拾取效果
+    Item() : Entity(EntityKind::Item, "ITEM"){}
 };
 
 class Monster : public Entity
 {
 public:
-    int hp;
-    int atk;
-    int def;
-    int gold;
+    int hp = 0;
+    int atk = 0;
+    int def = 0;
+    int gold = 0;
     QString traitID;
-    Monster() : Entity("MONSTER"){}
+    Monster() : Entity(EntityKind::Monster, "MONSTER"){}
 };
 
 class NPC : public Entity
 {
 public:
-    NPC() : Entity("NPC"){}
+    NPC() : Entity(EntityKind::NPC, "NPC"){}
 };
 
 class Merchant : public Entity
 {
 public:
-    Merchant() : Entity("MERCHANT"){}
+    Merchant() : Entity(EntityKind::Merchant, "MERCHANT"){}
 };
 
 class Stair : public Entity
 {
 public:
-    Stair() : Entity("STAIR"){}
+    int floorOffset = 0;    // 楼层变化：1上楼，-1下楼
+    Stair() : Entity(EntityKind::Stair, "STAIR"){}
 };
\ No newline at end of file
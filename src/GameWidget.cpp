@@ -2,6 +2,16 @@
 #include <QDebug>
 #include <QMessageBox>
 #include <QApplication>
+#include <QDir>
+#include <QDateTime>
+#include "Replay.h"
+#include <algorithm>
+#include <utility>
+
+// 缩放级别（相对配置中格子大小的百分比），DEFAULT_ZOOM为100%
+static const int ZOOM_PERCENT[] = {50, 75, 100, 125, 150, 200};
+static const int ZOOM_LEVELS = sizeof(ZOOM_PERCENT) / sizeof(ZOOM_PERCENT[0]);
+static const int DEFAULT_ZOOM = 2;
 
 //QT的渲染与信号/槽通讯均参考了AI给出的示例教程
 GameWidget::GameWidget(Data* data, Config* config, QWidget *parent)
@@ -9,26 +19,37 @@ GameWidget::GameWidget(Data* data, Config* config, QWidget *parent)
     , gameData(data)
     , gameConfig(config)
 {
-    //从配置读取渲染参数
-    blockSize = config->getBlockSize();
+    //从配置读取渲染参数，配置的格子大小为100%缩放时的大小
+    baseBlockSize = qMax(1, config->getBlockSize());
+    zoomLevel = DEFAULT_ZOOM;
+    blockSize = zoomBlockSize(zoomLevel);
+    
+    //加载图片资源，并按格子大小与屏幕的设备像素比预先缩放
+    imageManager.setCacheBudget(qint64(config->getSpriteCacheSize()) << 20);
+    tileDpr = devicePixelRatioF();
+    imageManager.loadResources(blockSize, QDir(data->getRootDir()).filePath("gamedata/sprites.txt"), tileDpr);
     
-    //加载图片资源
-    imageManager.loadResources();
+    //为每个实体句柄解析一次精灵句柄，绘制时直接按下标取图
+    entitySprites.resize(data->handleCount());
+    for (int handle = 0; handle < entitySprites.size(); ++handle) {
+        entitySprites[handle] = imageManager.findSprite(data->getEntityId(handle));
+    }
     
     //创建游戏逻辑处理器
     game = new Game(data, this);
+    game->setUndoDepth(config->getUndoDepth());
     
     //连接游戏逻辑信号
-    connect(game, &Game::heroStatusChanged, this, &GameWidget::heroStatusChanged);
-    connect(game, &Game::floorChanged, this, &GameWidget::floorChanged);
-    connect(game, &Game::mapUpdated, this, &GameWidget::onMapUpdated);
+    connect(game, &Game::stateChanged, this, &GameWidget::onStateChanged);
     connect(game, &Game::gameOver, this, [this]() {
+        clearInput();
         //显示游戏结束消息框
         QMessageBox::information(this, "游戏结束", "你被怪物击败了！");
         //关闭应用程序
         QApplication::quit();
     });
     connect(game, &Game::gameSuccess, this, [this]() {
+        clearInput();
         // 获取英雄数据，显示分数（使用HP作为分数）
         auto hero = getHeroData();
         int score = hero ? hero->hp : 0;
@@ -41,16 +62,37 @@ GameWidget::GameWidget(Data* data, Config* config, QWidget *parent)
     // 设置焦点策略，以便接收键盘事件
     setFocusPolicy(Qt::StrongFocus);
     
-    // 根据地图大小和格子大小设置组件尺寸
-    int width = gameData->map.len * blockSize;
-    int height = gameData->map.wid * blockSize;
-    setFixedSize(width, height);
+    // 组件尺寸为100%缩放时的视口大小，地图比视口小时按地图大小；视口不大于0时显示整个地图
+    // 缩放只改变视口中显示的格子数，组件尺寸不变
+    int viewLen = config->getViewLen() > 0 ? qMin(config->getViewLen(), gameData->map.len) : gameData->map.len;
+    int viewWid = config->getViewWid() > 0 ? qMin(config->getViewWid(), gameData->map.wid) : gameData->map.wid;
+    setFixedSize(viewLen * baseBlockSize, viewWid * baseBlockSize);
+    deadZone = QSize(qMax(1, config->getDeadZoneLen()), qMax(1, config->getDeadZoneWid()));
     
     // 设置背景色
     setAutoFillBackground(true);
     QPalette pal = palette();
     pal.setColor(QPalette::Window, Qt::black);
     setPalette(pal);
+    
+    // 所有动画共用一个时钟，只在有东西可动时运行
+    animationClock.setInterval(qMax(16, config->getAnimationInterval()));
+    connect(&animationClock, &QTimer::timeout, this, &GameWidget::onAnimationTick);
+    
+    // 逻辑以固定步长推进，按键只进入缓冲
+    tickInterval = qMax(1, config->getTickInterval());
+    moveInterval = qMax(tickInterval, config->getMoveInterval());
+    gameClock.start();
+    logicClock.setTimerType(Qt::PreciseTimer);
+    logicClock.setInterval(tickInterval);
+    connect(&logicClock, &QTimer::timeout, this, &GameWidget::onLogicTick);
+    
+    // 设备像素比变化后轮询新尺寸的图片是否已在后台缩放好
+    dprSwitchClock.setInterval(16);
+    connect(&dprSwitchClock, &QTimer::timeout, this, &GameWidget::onDprSwitchTick);
+    
+    // 预备相邻缩放级别，镜头从以勇者为中心开始
+    applyScale();
 }
 
 GameWidget::~GameWidget()
@@ -62,33 +104,392 @@ std::shared_ptr<HeroData> GameWidget::getHeroData()
     return game->getGameData()->getHeroData();
 }
 
-void GameWidget::onMapUpdated()
+void GameWidget::onStateChanged(const ChangeSet& change)
+{
+    //只有缓存范围内的变化需要标记，范围外的格子在滚动进来或换层重建时按当前数据绘制
+    for (const TileChange& tile : change.tiles) {
+        QPoint pos(tile.x, tile.y);
+        if (!viewCache.valid || tile.layer != viewCache.layer || !viewCache.tiles.contains(pos)) continue;
+        viewCache.dirty.append(pos);
+        viewCache.animated.removeOne(pos);
+        if (isAnimated(tile.after)) {
+            viewCache.animated.append(pos);
+        }
+        if (tile.layer == game->getCurrentFloor()) {
+            update(tileRect(tile.x, tile.y));
+        }
+    }
+    
+    if (change.heroChanged(HeroPosition) && !change.floorChanged()) {
+        //走一步换一帧行走图
+        heroFrame = (heroFrame + 1) % 4;
+        heroWalking = true;
+        
+        //相邻一格的移动在moveInterval内从旧格子插值到新格子
+        const HeroState& from = change.heroBefore;
+        const HeroState& to = change.heroAfter;
+        if (qAbs(from.posx - to.posx) + qAbs(from.posy - to.posy) == 1) {
+            moveFrom = QPoint(from.posx, from.posy);
+            moveTo = QPoint(to.posx, to.posy);
+            moveStart = gameClock.elapsed();
+        } else {
+            moveStart = -1;
+        }
+    }
+    
+    if (change.floorChanged()) {
+        //换层后镜头回到勇者中心，整个视口重绘
+        heroFrame = 0;
+        moveStart = -1;
+        updateCamera(gameClock.elapsed(), true);
+        update();
+    } else if (change.heroChanged(HeroPosition | HeroFace)) {
+        //勇者移动前后的格子都需要重绘；移动刚开始时绘制位置仍在旧格子，镜头一般不会变
+        if (updateCamera(gameClock.elapsed())) {
+            update();
+        } else {
+            update(heroRect);
+            update(currentHeroRect().translated(-camera));
+        }
+    }
+    
+    updateAnimationClock();
+    updateLogicClock();
+    emit stateChanged(change);
+}
+
+void GameWidget::onLogicTick()
+{
+    qint64 now = gameClock.elapsed();
+    
+    //按固定步长追赶到当前时间；落后太多时丢弃积压，避免卡顿后连续走多步
+    if (now - logicTime > 5 * tickInterval) {
+        logicTime = now - tickInterval;
+    }
+    while (logicTime + tickInterval <= now) {
+        logicTime += tickInterval;
+        stepLogic();
+    }
+    
+    //移动中的勇者每个时钟周期重绘一次，同一轮事件循环内的update会合并为一次绘制；
+    //镜头随勇者滚动时整个视口都要重绘
+    if (moveStart >= 0) {
+        if (updateCamera(now)) {
+            update();
+        } else {
+            update(heroRect);
+            update(QRect(heroDrawPos(now) - camera, QSize(blockSize, blockSize)));
+        }
+        if (now - moveStart >= moveInterval) {
+            moveStart = -1;
+        }
+    }
+    
+    updateLogicClock();
+}
+
+void GameWidget::stepLogic()
+{
+    if (logicTime < nextInputTime) return;
+    
+    //先处理缓冲的按键，缓冲为空时重复按住的方向
+    InputAction action = InputAction::None;
+    qint64 pressTime = -1;
+    if (!inputQueue.isEmpty()) {
+        BufferedInput input = inputQueue.dequeue();
+        action = input.action;
+        pressTime = input.time;
+    } else if (heldAction != InputAction::None) {
+        action = heldAction;
+    } else {
+        return;
+    }
+    
+    nextInputTime = logicTime + moveInterval;
+    game->handleInput(action);
+    
+    if (pressTime >= 0) {
+        qint64 latency = gameClock.elapsed() - pressTime;
+        ++frameStats.inputs;
+        frameStats.latencySum += latency;
+        frameStats.latencyMax = qMax(frameStats.latencyMax, latency);
+    }
+}
+
+void GameWidget::updateLogicClock()
+{
+    bool needed = !inputQueue.isEmpty() || heldAction != InputAction::None || moveStart >= 0;
+    if (needed && !logicClock.isActive()) {
+        //空闲后重新开始时从当前时间计起
+        logicTime = qMax(logicTime, gameClock.elapsed() - tickInterval);
+        logicClock.start();
+    } else if (!needed && logicClock.isActive()) {
+        logicClock.stop();
+        frameStats.lastPaint = -1;
+    }
+}
+
+void GameWidget::clearInput()
 {
-    update();//重绘
+    inputQueue.clear();
+    heldKey = 0;
+    heldAction = InputAction::None;
+    logicClock.stop();
+}
+
+void GameWidget::stopHeroMove()
+{
+    moveStart = -1;
+    if (updateCamera(gameClock.elapsed())) {
+        update();
+    } else {
+        update(heroRect);
+        update(currentHeroRect().translated(-camera));
+    }
+}
+
+QPoint GameWidget::heroDrawPos(qint64 now)
+{
+    if (moveStart < 0) {
+        return currentHeroRect().topLeft();
+    }
+    qreal t = qBound<qreal>(0, qreal(now - moveStart) / moveInterval, 1);
+    return ((QPointF(moveFrom) + QPointF(moveTo - moveFrom) * t) * blockSize).toPoint();
+}
+
+void GameWidget::recordFrame(qint64 now)
+{
+    //只统计逻辑时钟运行期间（有输入或移动时）的绘制
+    if (!logicClock.isActive()) return;
+    if (frameStats.lastPaint >= 0) {
+        qint64 interval = now - frameStats.lastPaint;
+        ++frameStats.frames;
+        frameStats.intervalSum += interval;
+        frameStats.intervalMax = qMax(frameStats.intervalMax, interval);
+    }
+    frameStats.lastPaint = now;
+    
+    //每5秒输出一次
+    if (now - frameStats.windowStart < 5000) return;
+    if (frameStats.frames > 0) {
+        qInfo().noquote() << QString("帧统计: %1帧，间隔平均%2ms/最大%3ms；%4次输入，延迟平均%5ms/最大%6ms")
+                                 .arg(frameStats.frames)
+                                 .arg(qreal(frameStats.intervalSum) / frameStats.frames, 0, 'f', 1)
+                                 .arg(frameStats.intervalMax)
+                                 .arg(frameStats.inputs)
+                                 .arg(frameStats.inputs ? qreal(frameStats.latencySum) / frameStats.inputs : 0.0, 0, 'f', 1)
+                                 .arg(frameStats.latencyMax);
+    }
+    qint64 lastPaint = frameStats.lastPaint;
+    frameStats = FrameStats();
+    frameStats.windowStart = now;
+    frameStats.lastPaint = lastPaint;
+}
+
+void GameWidget::onAnimationTick()
+{
+    ++animationFrame;
+    
+    //只重绘缓存范围内有动画的格子，视口外的部分由绘制时裁剪掉
+    if (viewCache.valid && viewCache.layer == game->getCurrentFloor()) {
+        for (const QPoint& pos : viewCache.animated) {
+            viewCache.dirty.append(pos);
+            update(tileRect(pos.x(), pos.y()));
+        }
+    }
+    
+    //勇者在一个时钟周期内没有再移动，恢复站立帧
+    if (!heroWalking && heroFrame != 0) {
+        heroFrame = 0;
+        update(heroRect);
+    }
+    heroWalking = false;
+    
+    updateAnimationClock();
+}
+
+void GameWidget::updateAnimationClock()
+{
+    bool needed = !viewCache.valid || viewCache.layer != game->getCurrentFloor()
+                  || !viewCache.animated.isEmpty() || heroFrame != 0;
+    if (needed && !animationClock.isActive()) {
+        animationClock.start();
+    } else if (!needed && animationClock.isActive()) {
+        animationClock.stop();
+    }
+}
+
+bool GameWidget::isAnimated(EntityHandle handle)
+{
+    return handle != AIR_HANDLE && imageManager.getFrameCount(spriteOf(handle)) > 1;
+}
+
+QRect GameWidget::worldTileRect(int x, int y) const
+{
+    return QRect(x * blockSize, y * blockSize, blockSize, blockSize);
+}
+
+QRect GameWidget::tileRect(int x, int y) const
+{
+    return worldTileRect(x, y).translated(-camera);
+}
+
+QRect GameWidget::currentHeroRect()
+{
+    auto hero = getHeroData();
+    return hero ? worldTileRect(hero->posx, hero->posy) : QRect();
+}
+
+// 一个方向上的镜头跟随：勇者超出静止区域多少，镜头就跟着移动多少；
+// 静止区域放不下勇者时让勇者保持居中，避免在区域两侧来回滚动
+static int followAxis(int camera, int hero, int block, int view, int zone)
+{
+    if (zone < block) {
+        return hero + (block - view) / 2;
+    }
+    int zoneStart = camera + (view - zone) / 2;
+    if (hero < zoneStart) {
+        return camera - (zoneStart - hero);
+    }
+    if (hero + block > zoneStart + zone) {
+        return camera + hero + block - zoneStart - zone;
+    }
+    return camera;
+}
+
+// 镜头不越过地图边缘；地图比视口小时居中显示
+static int clampAxis(int camera, int mapSize, int view)
+{
+    return mapSize < view ? (mapSize - view) / 2 : qBound(0, camera, mapSize - view);
+}
+
+bool GameWidget::updateCamera(qint64 now, bool center)
+{
+    QPoint hero = heroDrawPos(now);
+    QSize zone = center ? QSize() : (deadZone * blockSize).boundedTo(size());
+    QPoint target(clampAxis(followAxis(camera.x(), hero.x(), blockSize, width(), zone.width()),
+                            gameData->map.len * blockSize, width()),
+                  clampAxis(followAxis(camera.y(), hero.y(), blockSize, height(), zone.height()),
+                            gameData->map.wid * blockSize, height()));
+    if (target == camera) return false;
+    camera = target;
+    return true;
+}
+
+QRect GameWidget::visibleTiles() const
+{
+    //地图比视口小时镜头为负，与地图求交后只剩地图内的格子
+    return QRect(QPoint(camera.x() / blockSize, camera.y() / blockSize),
+                 QPoint((camera.x() + width() - 1) / blockSize, (camera.y() + height() - 1) / blockSize))
+           & QRect(0, 0, gameData->map.len, gameData->map.wid);
+}
+
+const QPixmap& GameWidget::viewPixmap()
+{
+    ViewCache& cache = viewCache;
+    int layer = game->getCurrentFloor();
+    QRect visible = visibleTiles();
+    
+    //缓存覆盖任意滚动位置下视口能碰到的格子数，从可见范围的左上角开始，靠近地图边缘时向内收
+    int cacheLen = qMin((width() - 1) / blockSize + 2, gameData->map.len);
+    int cacheWid = qMin((height() - 1) / blockSize + 2, gameData->map.wid);
+    //缓存按物理像素分配，绘制时仍使用逻辑坐标
+    qreal dpr = imageManager.getTileDpr();
+    QRect tiles(qMin(visible.left(), gameData->map.len - cacheLen),
+                qMin(visible.top(), gameData->map.wid - cacheWid), cacheLen, cacheWid);
+    
+    if (!cache.valid || cache.layer != layer) {
+        //进入楼层时整块绘制一次，同时找出有动画的格子
+        cache.pixmap = QPixmap(tiles.size() * blockSize * dpr);
+        cache.pixmap.setDevicePixelRatio(dpr);
+        cache.pixmap.fill(Qt::black);
+        cache.tiles = tiles;
+        cache.layer = layer;
+        cache.valid = true;
+        cache.dirty.clear();
+        cache.animated.clear();
+        QPainter painter(&cache.pixmap);
+        painter.translate(-tiles.topLeft() * blockSize);
+        drawCacheTiles(painter, gameData->map.getFloor(layer), tiles);
+        updateAnimationClock();
+    } else if (!cache.tiles.contains(visible)) {
+        //镜头越过格子边界：重叠部分整块拷贝到另一块缓冲，只绘制新露出的格子
+        QRect kept = cache.tiles & tiles;
+        if (cache.scratch.size() != cache.pixmap.size() || cache.scratch.devicePixelRatio() != dpr) {
+            cache.scratch = QPixmap(cache.pixmap.size());
+            cache.scratch.setDevicePixelRatio(dpr);
+        }
+        cache.scratch.fill(Qt::black);
+        QPainter painter(&cache.scratch);
+        if (!kept.isEmpty()) {
+            //源矩形以物理像素计
+            painter.drawPixmap(QPointF((kept.topLeft() - tiles.topLeft()) * blockSize), cache.pixmap,
+                               QRectF(QPointF((kept.topLeft() - cache.tiles.topLeft()) * blockSize) * dpr,
+                                      QSizeF(kept.size() * blockSize) * dpr));
+        }
+        
+        //移出范围的动画格子与脏格子不再维护
+        auto outside = [&tiles](const QPoint& pos) { return !tiles.contains(pos); };
+        cache.animated.erase(std::remove_if(cache.animated.begin(), cache.animated.end(), outside), cache.animated.end());
+        cache.dirty.erase(std::remove_if(cache.dirty.begin(), cache.dirty.end(), outside), cache.dirty.end());
+        
+        painter.translate(-tiles.topLeft() * blockSize);
+        drawCacheTiles(painter, gameData->map.getFloor(layer), tiles, kept);
+        painter.end();
+        std::swap(cache.pixmap, cache.scratch);
+        cache.tiles = tiles;
+        updateAnimationClock();
+    }
+    
+    if (!cache.dirty.isEmpty()) {
+        //之后只重绘被标记的格子
+        QPainter painter(&cache.pixmap);
+        painter.translate(-cache.tiles.topLeft() * blockSize);
+        const Floor& floor = gameData->map.getFloor(layer);
+        for (const QPoint& pos : cache.dirty) {
+            painter.fillRect(worldTileRect(pos.x(), pos.y()), Qt::black);
+            drawBlock(painter, pos.x(), pos.y(), floor.getBlock(pos.x(), pos.y()));
+        }
+        cache.dirty.clear();
+    }
+    return cache.pixmap;
 }
 
 void GameWidget::paintEvent(QPaintEvent *event)
 {
-    Q_UNUSED(event);
     QPainter painter(this);
     
-    //使用平滑缩放以获得更好的图片质量
-    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    //图片已按当前缩放级别与设备像素比缩放好，这里按1:1贴图，不开启平滑缩放
     
-    // 绘制地图（包含地板和实体）
-    drawMap(painter);
+    // 地板和实体来自视口缓存，只拷贝需要重绘的区域（可能是分散的多个格子）；
+    // 地图以外的部分保持背景色，源矩形以缓存的物理像素计
+    const QPixmap& cache = viewPixmap();
+    qreal dpr = cache.devicePixelRatio();
+    QPoint offset = camera - viewCache.tiles.topLeft() * blockSize;
+    QRect mapRect = QRect(QPoint(0, 0), QSize(gameData->map.len, gameData->map.wid) * blockSize).translated(-camera);
+    for (const QRect& dirtyRect : event->region()) {
+        QRect target = dirtyRect & mapRect;
+        if (target.isEmpty()) continue;
+        QRect source = target.translated(offset);
+        painter.drawPixmap(target, cache, QRectF(QPointF(source.topLeft()) * dpr, QSizeF(source.size()) * dpr));
+    }
     // 绘制英雄
     drawHero(painter);
+    
+    recordFrame(gameClock.elapsed());
 }
 
-void GameWidget::drawMap(QPainter &painter)
+void GameWidget::drawCacheTiles(QPainter &painter, const Floor &floor, const QRect &tiles, const QRect &skip)
 {
-    Floor& floor = gameData->map.getFloor(game->getCurrentFloor());
-    
-    for (int y = 0; y < gameData->map.wid; ++y) {
-        for (int x = 0; x < gameData->map.len; ++x) {
-            Block block = floor.getBlock(x, y);
-            drawBlock(painter, x, y, block);
+    //按行顺序遍历连续存放的格子，只访问范围内的部分
+    for (int y = tiles.top(); y <= tiles.bottom(); ++y) {
+        const Block* row = floor.row(y);
+        for (int x = tiles.left(); x <= tiles.right(); ++x) {
+            if (skip.contains(x, y)) continue;
+            drawBlock(painter, x, y, row[x]);
+            if (isAnimated(row[x].entity)) {
+                viewCache.animated.append(QPoint(x, y));
+            }
         }
     }
 }
@@ -97,56 +498,83 @@ void GameWidget::drawBlock(QPainter &painter, int x, int y, const Block &block)
 {
     int px = x * blockSize;
     int py = y * blockSize;
-    QRect targetRect(px, py, blockSize, blockSize);
     
     // 绘制地板
-    QPixmap floorPixmap = imageManager.getFloorImage(block.floorId);
-    painter.drawPixmap(targetRect, floorPixmap);
+    painter.drawPixmap(px, py, imageManager.getFloorTile(block.floorId));
     
     // 绘制实体（填充整格，无边距）
-    if (!block.entityId.isEmpty() && block.entityId != "air") {
-        QPixmap entityPixmap = imageManager.getEntityImage(block.entityId);
-        painter.drawPixmap(targetRect, entityPixmap);
+    if (block.entity != AIR_HANDLE) {
+        painter.drawPixmap(px, py, imageManager.getSpriteTile(spriteOf(block.entity), animationFrame));
         
-        // 如果是怪物，显示其hp，atk，def属性
-        auto entity = gameData->getEntity(block.entityId);
-        if (entity && entity->type == "MONSTER") {
-            Monster* monster = static_cast<Monster*>(entity.get());
-            if (monster) {
-                // 设置字体和颜色
-                painter.setPen(Qt::white);
-                painter.setFont(QFont("Arial", blockSize / 6, QFont::Bold));
-                
-                // 右对齐显示属性，显示在右下角
-                QString hpText = QString("HP:%1").arg(monster->hp);
-                QString atkText = QString("ATK:%1").arg(monster->atk);
-                QString defText = QString("DEF:%1").arg(monster->def);
-                
-                //计算文本位置
-                int margin = 2;
-                int lineHeight=blockSize/6+margin;
-                
-                // 绘制文本，右对齐
-                painter.drawText(px+margin,py+blockSize-3*lineHeight,blockSize-2*margin,lineHeight,Qt::AlignRight, hpText);
-                painter.drawText(px+margin,py+blockSize-2*lineHeight,blockSize-2*margin,lineHeight,Qt::AlignRight, atkText);
-                painter.drawText(px+margin,py+blockSize-lineHeight,blockSize-2*margin,lineHeight,Qt::AlignRight, defText);
-            }
+        // 如果是怪物，叠加预先渲染好的hp，atk，def属性标签
+        const auto& entity = gameData->getEntity(block.entity);
+        if (entity && entity->kind == EntityKind::Monster) {
+            painter.drawPixmap(px, py, monsterLabel(block.entity, static_cast<const Monster&>(*entity)));
         }
     }
 }
 
+SpriteHandle GameWidget::spriteOf(EntityHandle handle)
+{
+    //加载后新登记的占位句柄在第一次绘制时解析
+    while (entitySprites.size() <= handle) {
+        entitySprites.append(imageManager.findSprite(gameData->getEntityId(entitySprites.size())));
+    }
+    return entitySprites[handle];
+}
+
+quint64 GameWidget::labelKey(EntityHandle handle, int blockSize, qreal dpr)
+{
+    return (quint64(handle) << 48) | (quint64(quint32(blockSize)) << 16) | quint16(qRound(dpr * 100));
+}
+
+const QPixmap& GameWidget::monsterLabel(EntityHandle handle, const Monster& monster)
+{
+    qreal dpr = imageManager.getTileDpr();
+    MonsterLabel& label = monsterLabels[labelKey(handle, blockSize, dpr)];
+    if (!label.pixmap.isNull()
+        && label.hp == monster.hp && label.atk == monster.atk && label.def == monster.def) {
+        return label.pixmap;
+    }
+    
+    //首次在这一尺寸绘制或怪物属性变化时重新渲染到透明图片
+    label.hp = monster.hp;
+    label.atk = monster.atk;
+    label.def = monster.def;
+    label.pixmap = QPixmap(QSize(blockSize, blockSize) * dpr);
+    label.pixmap.setDevicePixelRatio(dpr);
+    label.pixmap.fill(Qt::transparent);
+    
+    QPainter painter(&label.pixmap);
+    // 设置字体和颜色
+    painter.setPen(Qt::white);
+    painter.setFont(QFont("Arial", blockSize / 6, QFont::Bold));
+    
+    // 右对齐显示属性，显示在右下角
+    QString hpText = QString("HP:%1").arg(monster.hp);
+    QString atkText = QString("ATK:%1").arg(monster.atk);
+    QString defText = QString("DEF:%1").arg(monster.def);
+    
+    //计算文本位置
+    int margin = 2;
+    int lineHeight=blockSize/6+margin;
+    
+    // 绘制文本，右对齐
+    painter.drawText(margin,blockSize-3*lineHeight,blockSize-2*margin,lineHeight,Qt::AlignRight, hpText);
+    painter.drawText(margin,blockSize-2*lineHeight,blockSize-2*margin,lineHeight,Qt::AlignRight, atkText);
+    painter.drawText(margin,blockSize-lineHeight,blockSize-2*margin,lineHeight,Qt::AlignRight, defText);
+    return label.pixmap;
+}
+
 void GameWidget::drawHero(QPainter &painter)
 {
     auto hero = getHeroData();
     if (!hero) return;
     
-    int px = hero->posx * blockSize;
-    int py = hero->posy * blockSize;
-    QRect targetRect(px, py, blockSize, blockSize);
+    heroRect = QRect(heroDrawPos(gameClock.elapsed()) - camera, QSize(blockSize, blockSize));
     
     // 绘制英雄
-    QPixmap heroPixmap = imageManager.getHeroImage(hero->face, 0);
-    painter.drawPixmap(targetRect, heroPixmap);
+    painter.drawPixmap(heroRect.topLeft(), imageManager.getHeroTile(hero->face, heroFrame));
 }
 
 InputAction GameWidget::keyToAction(int key)
@@ -169,11 +597,167 @@ void GameWidget::keyPressEvent(QKeyEvent *event)
 {
     InputAction action = keyToAction(event->key());
     
-    if (action != InputAction::None) {
-        game->handleInput(action);
-        update();  // 重绘
+    if (event->key() == Qt::Key_F5 && !event->isAutoRepeat()) {
+        // 快速存档
+        game->quickSave(0);
+    } else if (event->key() == Qt::Key_F6 && !event->isAutoRepeat()) {
+        // 保存录像
+        saveReplay();
+    } else if (event->key() == Qt::Key_F9 && !event->isAutoRepeat()) {
+        // 快速读档，丢弃读档前缓冲的输入，勇者直接出现在存档位置
+        inputQueue.clear();
+        if (game->quickLoad(0)) {
+            stopHeroMove();
+        }
+    } else if (event->key() == Qt::Key_Plus || event->key() == Qt::Key_Equal) {
+        // 放大
+        setZoom(zoomLevel + 1);
+    } else if (event->key() == Qt::Key_Minus) {
+        // 缩小
+        setZoom(zoomLevel - 1);
+    } else if (event->key() == Qt::Key_0) {
+        // 恢复100%
+        setZoom(DEFAULT_ZOOM);
+    } else if (event->key() == Qt::Key_Z || event->key() == Qt::Key_Y) {
+        // 撤销/重做，按住时随系统按键重复连续执行
+        inputQueue.clear();
+        bool done = event->key() == Qt::Key_Z ? game->undo() : game->redo();
+        if (done) {
+            stopHeroMove();
+        }
+    } else if (action != InputAction::None) {
+        // 系统的按键重复不进入缓冲，按住时由逻辑时钟按moveInterval重复，移动速度与重复频率无关
+        if (!event->isAutoRepeat()) {
+            if (inputQueue.size() < INPUT_QUEUE_LIMIT) {
+                inputQueue.enqueue({action, gameClock.elapsed()});
+            }
+            heldKey = event->key();
+            heldAction = action;
+            updateLogicClock();
+        }
     } else {
         QWidget::keyPressEvent(event);
     }
 }
 
+void GameWidget::wheelEvent(QWheelEvent *event)
+{
+    // 滚轮每一格缩放一级，触控板的小步长累计满一格再缩放
+    wheelDelta += event->angleDelta().y();
+    while (wheelDelta >= 120) {
+        wheelDelta -= 120;
+        setZoom(zoomLevel + 1);
+    }
+    while (wheelDelta <= -120) {
+        wheelDelta += 120;
+        setZoom(zoomLevel - 1);
+    }
+    event->accept();
+}
+
+int GameWidget::zoomBlockSize(int level) const
+{
+    return qMax(1, baseBlockSize * ZOOM_PERCENT[level] / 100);
+}
+
+void GameWidget::setZoom(int level)
+{
+    level = qBound(0, level, ZOOM_LEVELS - 1);
+    if (level == zoomLevel) return;
+    zoomLevel = level;
+    applyScale();
+}
+
+void GameWidget::applyScale()
+{
+    blockSize = zoomBlockSize(zoomLevel);
+    qreal dpr = tileDpr;
+    imageManager.setTileScale(blockSize, dpr);
+    // 相邻级别在后台预先缩放，下次缩放时图片已经准备好
+    if (zoomLevel > 0) {
+        imageManager.prepareTileScale(zoomBlockSize(zoomLevel - 1), dpr);
+    }
+    if (zoomLevel < ZOOM_LEVELS - 1) {
+        imageManager.prepareTileScale(zoomBlockSize(zoomLevel + 1), dpr);
+    }
+    
+    // 视口缓存按新的格子大小重建，镜头回到勇者中心
+    viewCache.valid = false;
+    updateCamera(gameClock.elapsed(), true);
+    updateAnimationClock();
+    update();
+}
+
+bool GameWidget::event(QEvent *event)
+{
+    // 窗口移到设备像素比不同的屏幕时在后台准备新的图片，准备好之前继续使用当前的图片
+#if QT_VERSION >= QT_VERSION_CHECK(6, 6, 0)
+    if (event->type() == QEvent::DevicePixelRatioChange || event->type() == QEvent::ScreenChangeInternal) {
+#else
+    if (event->type() == QEvent::ScreenChangeInternal) {
+#endif
+        onDevicePixelRatioChanged();
+    }
+    return QWidget::event(event);
+}
+
+void GameWidget::onDevicePixelRatioChanged()
+{
+    qreal dpr = devicePixelRatioF();
+    if (qFuzzyCompare(dpr, tileDpr)) {
+        dprSwitchClock.stop();
+        return;
+    }
+    pendingDpr = dpr;
+    imageManager.prepareTileScale(blockSize, pendingDpr);
+    dprSwitchClock.start();
+}
+
+void GameWidget::onDprSwitchTick()
+{
+    // 期间缩放过或缓存被换出时重新预备，prepareTileScale对已有的尺寸不做任何事
+    imageManager.prepareTileScale(blockSize, pendingDpr);
+    if (!imageManager.isTileScaleReady(blockSize, pendingDpr)) return;
+    dprSwitchClock.stop();
+    tileDpr = pendingDpr;
+    applyScale();
+}
+
+void GameWidget::saveReplay()
+{
+    if (!game->isInputHistoryValid()) {
+        qInfo() << "撤销越过了快速读档，当前状态无法由输入序列重现，未保存录像";
+        return;
+    }
+    Replay replay;
+    replay.towerHash = gameData->getContentHash();
+    replay.finalHash = game->stateHash();
+    replay.actions = game->getInputHistory();
+
+    QDir dir(gameData->getRootDir());
+    dir.mkpath("replays");
+    QString path = dir.filePath("replays/" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".mrp");
+    try {
+        replay.save(path);
+        qInfo() << "录像已保存:" << path << "输入数:" << replay.actions.size();
+    } catch (const QString& e) {
+        qWarning() << e;
+    }
+}
+
+void GameWidget::keyReleaseEvent(QKeyEvent *event)
+{
+    if (!event->isAutoRepeat() && event->key() == heldKey) {
+        heldKey = 0;
+        heldAction = InputAction::None;
+    }
+    QWidget::keyReleaseEvent(event);
+}
+
+void GameWidget::focusOutEvent(QFocusEvent *event)
+{
+    // 失去焦点后收不到松开事件，不再当作按住
+    heldKey = 0;
+    heldAction = InputAction::None;
+    QWidget::focusOutEvent(event);
+}
@@ -6,6 +6,13 @@
 #include <QPainter>
 #include <QKeyEvent>
 #include <QMouseEvent>
+#include <QWheelEvent>
+#include <QPixmap>
+#include <QVector>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QQueue>
 #include <memory>
 #include "DataManager.h"
 #include "Config.h"
@@ -28,31 +35,96 @@ public:
     std::shared_ptr<HeroData> getHeroData();
 
 signals:
-    // 英雄状态改变信号（用于更新状态面板）
-    void heroStatusChanged();
-    // 楼层改变信号
-    void floorChanged(int floor);
+    // 游戏状态变化信号（转发Game::stateChanged，用于更新状态面板）
+    void stateChanged(const ChangeSet& change);
 
 protected:
     // 绑定绘图事件
     void paintEvent(QPaintEvent *event) override;
-    // 绑定键盘事件
+    // 绑定键盘事件：按键只进入输入缓冲，由逻辑时钟处理
     void keyPressEvent(QKeyEvent *event) override;
+    void keyReleaseEvent(QKeyEvent *event) override;
+    void focusOutEvent(QFocusEvent *event) override;
+    // 滚轮缩放
+    void wheelEvent(QWheelEvent *event) override;
+    // 设备像素比变化（窗口移到另一块屏幕）
+    bool event(QEvent *event) override;
 
 private slots:
-    // 响应游戏状态更新
-    void onMapUpdated();
+    // 按变化记录标记脏格子，只重绘变化的格子与勇者移动前后的格子
+    void onStateChanged(const ChangeSet& change);
+    // 动画时钟：推进帧序号，只重绘当前楼层的动画格子与勇者
+    void onAnimationTick();
+    // 逻辑时钟：按固定步长追赶到当前时间，并重绘移动中的勇者
+    void onLogicTick();
 
 private:
-    // 绘制地图
-    void drawMap(QPainter &painter);
+    // 视口范围内地板与实体合成后的缓存，比视口多一行一列，覆盖任意滚动位置下可见的全部格子；
+    // 镜头越过格子边界时平移已有内容，只绘制新露出的格子，绘制开销与地图大小无关
+    struct ViewCache {
+        QPixmap pixmap;
+        QPixmap scratch;            // 平移时使用的第二块缓冲，交替使用避免每次分配
+        bool valid = false;
+        int layer = -1;
+        QRect tiles;                // 缓存覆盖的格子范围
+        QVector<QPoint> dirty;
+        QVector<QPoint> animated;   // 范围内实体有多帧动画的格子，随缓存一起建立和维护
+    };
+
+    // 取得覆盖当前可见格子的缓存，必要时重建、平移或重绘脏格子
+    const QPixmap& viewPixmap();
+    // 在缓存中绘制一块格子范围（跳过skip中已有的格子）并登记其中的动画格子
+    void drawCacheTiles(QPainter &painter, const Floor &floor, const QRect &tiles, const QRect &skip = QRect());
+    // 与视口相交的格子范围
+    QRect visibleTiles() const;
+    // 镜头跟随勇者的绘制位置，勇者离开中央的静止区域时才滚动，center时直接以勇者为中心；
+    // 镜头位置变化时返回true
+    bool updateCamera(qint64 now, bool center = false);
+    // 格子在地图（世界坐标）与组件中的矩形
+    QRect worldTileRect(int x, int y) const;
+    QRect tileRect(int x, int y) const;
+    // 勇者当前所在格子的矩形（世界坐标）
+    QRect currentHeroRect();
+    // 实体是否有多帧动画
+    bool isAnimated(EntityHandle handle);
+    // 当前楼层有动画格子或勇者在走动时才运行动画时钟
+    void updateAnimationClock();
+
     // 绘制英雄
     void drawHero(QPainter &painter);
     // 绘制单个格子
     void drawBlock(QPainter &painter, int x, int y, const Block &block);
+    // 实体句柄对应的精灵句柄
+    SpriteHandle spriteOf(EntityHandle handle);
+    // 取得怪物属性标签，按怪物与缩放尺寸缓存，属性变化时重新渲染
+    const QPixmap& monsterLabel(EntityHandle handle, const Monster& monster);
+
+    // 缩放级别对应的格子大小
+    int zoomBlockSize(int level) const;
+    // 切换缩放级别，超出范围时取最近的级别
+    void setZoom(int level);
+    // 按当前缩放级别与设备像素比切换图片缓存并重建视口缓存
+    void applyScale();
+    // 设备像素比变化时在后台准备对应的图片，轮询到准备好后再切换，绘制中不做缩放
+    void onDevicePixelRatioChanged();
+    void onDprSwitchTick();
 
     // 将键盘按键转换为输入动作
     InputAction keyToAction(int key);
+    // 推进一个逻辑步长：取出一个缓冲输入或按住的方向交给Game
+    void stepLogic();
+    // 逻辑时钟只在有输入或勇者在移动时运行
+    void updateLogicClock();
+    // 停止处理输入（游戏结束时）
+    void clearInput();
+    // 读档/撤销后勇者直接出现在目标格子，不做移动插值
+    void stopHeroMove();
+    // 把从加载开始的输入序列保存为录像：<根目录>/replays/<时间>.mrp
+    void saveReplay();
+    // 勇者当前应绘制的世界坐标（移动中为两格之间的插值）
+    QPoint heroDrawPos(qint64 now);
+    // 记录一次绘制，周期性输出帧间隔与输入延迟
+    void recordFrame(qint64 now);
 
     // 游戏逻辑处理器
     Game* game;
@@ -64,5 +136,76 @@ private:
     ImageManager imageManager;
     
     // 渲染参数（从配置读取）
-    int blockSize;          // 格子大小（像素）
+    int baseBlockSize;      // 100%缩放时的格子大小（像素）
+    int blockSize;          // 当前缩放级别的格子大小（逻辑像素）
+    int zoomLevel;
+    qreal tileDpr;          // 当前绘制使用的设备像素比
+    qreal pendingDpr = 0;   // 等待后台缩放完成后切换到的设备像素比
+    QTimer dprSwitchClock;
+    int wheelDelta = 0;     // 未满一格的滚轮累计量
+    QSize deadZone;         // 镜头静止区域（格子数），勇者在其中移动时不滚动
+
+    // 实体句柄到精灵句柄的映射，加载时解析
+    QVector<SpriteHandle> entitySprites;
+    
+    // 视口的合成缓存
+    ViewCache viewCache;
+    // 镜头：视口左上角的世界坐标（像素）
+    QPoint camera;
+    
+    // 预先渲染的怪物属性标签，按(怪物, 格子大小, 设备像素比)缓存，回到之前的缩放级别时直接复用；
+    // 记录渲染时的属性，属性变化时重新渲染
+    struct MonsterLabel {
+        QPixmap pixmap;
+        int hp = 0;
+        int atk = 0;
+        int def = 0;
+    };
+    static quint64 labelKey(EntityHandle handle, int blockSize, qreal dpr);
+    QHash<quint64, MonsterLabel> monsterLabels;
+    // 上次绘制勇者的位置
+    QRect heroRect;
+    
+    // 全组件共用的动画时钟及当前帧序号
+    QTimer animationClock;
+    int animationFrame = 0;
+    // 勇者行走帧，移动一步前进一帧，停下后的下一个时钟恢复站立帧
+    int heroFrame = 0;
+    bool heroWalking = false;
+    
+    // 固定步长的逻辑时钟，输入与绘制解耦
+    QTimer logicClock;
+    QElapsedTimer gameClock;        // 组件创建以来的时间，所有时间戳以此为准
+    qint64 logicTime = 0;           // 逻辑已推进到的时间
+    int tickInterval;               // 逻辑步长（毫秒）
+    int moveInterval;               // 走一格的时间，也是连续输入的最小间隔
+    qint64 nextInputTime = 0;       // 下一个输入最早的处理时间
+    
+    // 输入缓冲：按下的动作及按下时间；按住的方向在缓冲为空时重复
+    struct BufferedInput {
+        InputAction action;
+        qint64 time;
+    };
+    QQueue<BufferedInput> inputQueue;
+    static const int INPUT_QUEUE_LIMIT = 2;
+    int heldKey = 0;
+    InputAction heldAction = InputAction::None;
+    
+    // 勇者在两格之间的移动插值（格子坐标），moveStart<0表示没有在移动
+    QPoint moveFrom;
+    QPoint moveTo;
+    qint64 moveStart = -1;
+    
+    // 帧统计：运动期间的绘制间隔与输入到处理的延迟
+    struct FrameStats {
+        qint64 windowStart = 0;
+        qint64 lastPaint = -1;
+        int frames = 0;
+        qint64 intervalSum = 0;
+        qint64 intervalMax = 0;
+        int inputs = 0;
+        qint64 latencySum = 0;
+        qint64 latencyMax = 0;
+    };
+    FrameStats frameStats;
 };
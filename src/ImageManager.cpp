@@ -1,25 +1,249 @@
 #include "ImageManager.h"
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QRunnable>
+#include <QThreadPool>
+#include <functional>
+#include <utility>
 
-void ImageManager::loadResources()
+namespace {
+// 线程池中执行的一个任务
+class SheetTask : public QRunnable
 {
-    loadTerrains();
-    loadAnimates();
-    loadItems();
-    loadEnemys();
-    loadHero();
-    loadLackResource();
+public:
+    explicit SheetTask(std::function<void()> work) : work(std::move(work)) {}
+    void run() override { work(); }
+
+private:
+    std::function<void()> work;
+};
+}
+
+void ImageManager::loadResources(int tileSize, const QString& manifestPath, qreal dpr)
+{
+    QElapsedTimer timer;
+    timer.start();
+    scaledSets.clear();
+    tileCache.reset();
+
+    // 精灵清单中的精灵按所在精灵图分组，地板也切自地形精灵图
+    QMap<QString, SheetJob> sheetJobs;
+    loadManifest(manifestPath, sheetJobs);
+    SheetJob& terrains = sheetJobs["terrains"];
+    terrains.name = "terrains";
+    terrains.path = ":/images/terrains.png";
+    addFloorCrops(terrains);
+
+    QVector<SheetJob> jobs;
+    for (const SheetJob& job : sheetJobs) {
+        jobs << job;
+    }
+    jobs << heroJob() << lackResourceJob();
+
+    // PNG解码与切割互不依赖，交给线程池并行完成；QImage可以在非GUI线程使用
+    for (SheetJob& job : jobs) {
+        scalePool.start(new SheetTask([&job]() { decodeSheet(job); }));
+    }
+    scalePool.waitForDone();
+    qint64 decodeMs = timer.elapsed();
+
+    // QPixmap只能在GUI线程创建
+    int frameCount = sprites.last().firstFrame + sprites.last().frameCount;
+    spriteCache = SpriteSet();
+    spriteCache.frames.resize(frameCount);
+    spriteCache.floor.resize(floorSpriteMap.isEmpty() ? 0 : floorSpriteMap.lastKey() + 1);
+    spriteCache.hero.resize(16);
+    sourceImages = QVector<QImage>(frameCount + spriteCache.floor.size() + spriteCache.hero.size() + 1);
+    for (const SheetJob& job : jobs) {
+        uploadSheet(job);
+    }
+
+    if (spriteCache.lack.isNull()) {
+        qFatal("无法加载缺失材质: :/images/lack_resource.png");
+    }
+    qint64 uploadMs = timer.elapsed() - decodeMs;
+
+    // 当前尺寸立即缩放，其他尺寸在使用或预备时再缩放
+    setTileScale(tileSize, dpr);
+
+    qInfo().noquote() << QString("精灵图加载: %1个精灵，解码与切割%2ms（%3线程），上传%4ms，缩放%5ms，共%6ms")
+                             .arg(sprites.size() - 1).arg(decodeMs).arg(scalePool.maxThreadCount()).arg(uploadMs)
+                             .arg(timer.elapsed() - decodeMs - uploadMs).arg(timer.elapsed());
 }
 
-void ImageManager::loadTerrains()
+quint64 ImageManager::scaleKey(int tileSize, qreal dpr)
 {
-    // 加载地形精灵图
-    terrainsSheet = QPixmap(":/images/terrains.png");
-    if (terrainsSheet.isNull()) {
-        qWarning() << "无法加载地形精灵图: :/images/terrains.png";
+    return (quint64(quint32(tileSize)) << 32) | quint32(qRound(dpr * 100));
+}
+
+void ImageManager::setTileScale(int tileSize, qreal dpr)
+{
+    std::shared_ptr<ScaledSet>& set = scaledSets[scaleKey(tileSize, dpr)];
+    if (!set) {
+        set = startScale(tileSize, dpr, 1);
+    }
+    if (!set->uploaded) {
+        uploadScaled(*set);
+    }
+    set->lastUse = ++useClock;
+    tileCache = set;
+    this->tileSize = tileSize;
+    tileDpr = dpr;
+    trimCaches();
+}
+
+void ImageManager::prepareTileScale(int tileSize, qreal dpr)
+{
+    if (tileSize <= 0) {
         return;
     }
-    
+    std::shared_ptr<ScaledSet>& set = scaledSets[scaleKey(tileSize, dpr)];
+    if (!set) {
+        set = startScale(tileSize, dpr, 0);
+    }
+    set->lastUse = ++useClock;
+    trimCaches();
+}
+
+bool ImageManager::isTileScaleReady(int tileSize, qreal dpr) const
+{
+    auto it = scaledSets.constFind(scaleKey(tileSize, dpr));
+    if (it == scaledSets.constEnd()) {
+        return false;
+    }
+    const ScaledSet& set = *it.value();
+    return set.uploaded || set.finished.available() >= set.taskCount;
+}
+
+std::shared_ptr<ImageManager::ScaledSet> ImageManager::startScale(int tileSize, qreal dpr, int priority)
+{
+    auto set = std::make_shared<ScaledSet>();
+    set->tileSize = tileSize;
+    set->dpr = dpr;
+    int pixelSize = qMax(1, qRound(tileSize * dpr));
+    set->images.resize(sourceImages.size());
+    set->bytes = qint64(sourceImages.size()) * pixelSize * pixelSize * 4;
+
+    // 按线程数分块，各任务写入结果中互不重叠的下标；先取得数据指针，任务中不会触发拷贝
+    QImage* results = set->images.data();
+    const QVector<QImage> sources = sourceImages;
+    int chunk = (sources.size() + scalePool.maxThreadCount() - 1) / qMax(1, scalePool.maxThreadCount());
+    for (int begin = 0; begin < sources.size(); begin += qMax(1, chunk)) {
+        int end = qMin(begin + qMax(1, chunk), int(sources.size()));
+        ++set->taskCount;
+        scalePool.start(new SheetTask([set, sources, results, begin, end, pixelSize]() {
+            for (int i = begin; i < end; ++i) {
+                results[i] = scaleSprite(sources[i], pixelSize);
+            }
+            set->finished.release();
+        }), priority);
+    }
+    return set;
+}
+
+void ImageManager::uploadScaled(ScaledSet& set)
+{
+    // 只等待这一尺寸的任务，后台预备的其他尺寸继续在线程池中执行
+    set.finished.acquire(set.taskCount);
+    auto upload = [&set](const QImage& image) {
+        QPixmap pixmap = QPixmap::fromImage(image);
+        pixmap.setDevicePixelRatio(set.dpr);
+        return pixmap;
+    };
+    set.tiles.frames.resize(spriteCache.frames.size());
+    set.tiles.floor.resize(spriteCache.floor.size());
+    set.tiles.hero.resize(spriteCache.hero.size());
+    for (int i = 0; i < set.tiles.frames.size(); ++i) {
+        set.tiles.frames[i] = upload(set.images[sourceIndex(SpriteCrop::Frame, i)]);
+    }
+    for (int i = 0; i < set.tiles.floor.size(); ++i) {
+        set.tiles.floor[i] = upload(set.images[sourceIndex(SpriteCrop::Floor, i)]);
+    }
+    for (int i = 0; i < set.tiles.hero.size(); ++i) {
+        set.tiles.hero[i] = upload(set.images[sourceIndex(SpriteCrop::Hero, i)]);
+    }
+    set.tiles.lack = upload(set.images.last());
+    set.images.clear();
+    set.uploaded = true;
+}
+
+void ImageManager::trimCaches()
+{
+    qint64 total = 0;
+    for (const auto& set : std::as_const(scaledSets)) {
+        total += set->bytes;
+    }
+    // 后台缩放中的缓存被换出时，任务持有的引用保证结果写入仍然有效
+    while (total > cacheBudget) {
+        auto oldest = scaledSets.end();
+        for (auto it = scaledSets.begin(); it != scaledSets.end(); ++it) {
+            if (it.value() != tileCache && (oldest == scaledSets.end() || it.value()->lastUse < oldest.value()->lastUse)) {
+                oldest = it;
+            }
+        }
+        if (oldest == scaledSets.end()) {
+            break;
+        }
+        total -= oldest.value()->bytes;
+        scaledSets.erase(oldest);
+    }
+}
+
+void ImageManager::loadManifest(const QString& manifestPath, QMap<QString, SheetJob>& sheetJobs)
+{
+    sprites.clear();
+    spriteIds.clear();
+    // 0号精灵为缺失材质，不占用帧
+    sprites.append({QString(), 0, 0});
+
+    QFile file(manifestPath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning().noquote() << "无法打开精灵清单: " + manifestPath;
+        return;
+    }
+
+    // 每行：实体ID 精灵图 行 列 [帧数]
+    QTextStream in(&file);
+    int lineNumber = 0;
+    int nextFrame = 0;
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty() || line.startsWith("#")) {
+            continue;
+        }
+
+        QStringList fields = line.split(' ', Qt::SkipEmptyParts);
+        bool rowOk = false, colOk = false, framesOk = true;
+        int row = fields.value(2).toInt(&rowOk);
+        int col = fields.value(3).toInt(&colOk);
+        int frames = fields.size() > 4 ? fields[4].toInt(&framesOk) : 1;
+        if (fields.size() < 4 || fields.size() > 5 || !rowOk || !colOk || !framesOk
+            || row < 0 || col < 0 || frames < 1) {
+            qWarning().noquote() << QString("精灵清单%1第%2行格式错误: %3").arg(manifestPath).arg(lineNumber).arg(line);
+            continue;
+        }
+        if (spriteIds.contains(fields[0])) {
+            qWarning().noquote() << QString("精灵清单%1第%2行重复定义: %3").arg(manifestPath).arg(lineNumber).arg(fields[0]);
+            continue;
+        }
+
+        SheetJob& job = sheetJobs[fields[1]];
+        job.name = fields[1];
+        job.path = ":/images/" + fields[1] + ".png";
+        for (int frame = 0; frame < frames; ++frame) {
+            job.crops.append({SpriteCrop::Frame, nextFrame + frame, {row, col + frame}});
+        }
+        spriteIds[fields[0]] = sprites.size();
+        sprites.append({fields[0], nextFrame, frames});
+        nextFrame += frames;
+    }
+}
+
+void ImageManager::addFloorCrops(SheetJob& job)
+{
     // 地板映射
     floorSpriteMap[0] = {1, 0};  // 默认地板
     floorSpriteMap[1] = {0, 0};  // 草地
@@ -27,120 +251,180 @@ void ImageManager::loadTerrains()
     
     // 预切割并缓存地板图片
     for (auto it = floorSpriteMap.begin(); it != floorSpriteMap.end(); ++it) {
-        floorCache[it.key()] = cropSprite(terrainsSheet, it.value().row, it.value().col);
+        job.crops.append({SpriteCrop::Floor, it.key(), it.value()});
     }
-    
-    // 预切割并缓存实体图片
-    entityCache["up_stair"] = cropSprite(terrainsSheet, 6, 0);     // 上楼梯 - 第7行（索引6）
-    entityCache["down_stair"] = cropSprite(terrainsSheet, 5, 0);   // 下楼梯 - 第6行（索引5）
 }
 
-void ImageManager::loadHero()
+void ImageManager::decodeSheet(SheetJob& job)
 {
-    // 加载英雄精灵图
-    heroSheet = QPixmap(":/images/brave.png");
-    if (heroSheet.isNull()) {
-        qWarning() << "无法加载英雄精灵图: :/images/brave.png";
+    job.sheet = QImage(job.path);
+    if (job.sheet.isNull()) {
         return;
     }
-    
-    // 预切割并缓存所有英雄帧 (4行4列)
-    for (int face = 0; face < 4; ++face) {
-        for (int frame = 0; frame < 4; ++frame) {
-            int key = face * 4 + frame;
-            heroCache[key] = cropSprite(heroSheet, face, frame);
-        }
+    // 预先转换为预乘格式，上传QPixmap时不再需要逐像素转换
+    job.sheet = job.sheet.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    job.images.reserve(job.crops.size());
+    for (const SpriteCrop& crop : job.crops) {
+        job.images.append(cropSprite(job.sheet, crop.pos.row, crop.pos.col));
+    }
+    if (!job.keepSheet) {
+        job.sheet = QImage();
     }
 }
 
-void ImageManager::loadAnimates()
+QImage ImageManager::scaleSprite(const QImage& sprite, int size)
 {
-    // 加载动画精灵图
-    animatesSheet = QPixmap(":/images/animates.png");
-    if (animatesSheet.isNull()) {
-        qWarning() << "无法加载动画精灵图: :/images/animates.png";
-        return;
+    if (sprite.isNull() || (sprite.width() == size && sprite.height() == size)) {
+        return sprite;
     }
-    
-    // 处理墙和门的材质
-    entityCache["wall"] = cropSprite(animatesSheet, 10, 0);   // 墙 - 第11行第1列（行索引10，列索引0）
-    entityCache["yellow_door"] = cropSprite(animatesSheet, 4, 0);  // 黄门 - 第五行第1列（行索引4，列索引0）
-    entityCache["blue_door"] = cropSprite(animatesSheet, 5, 0);     // 蓝门 - 第六行第1列（行索引5，列索引0）
-    entityCache["red_door"] = cropSprite(animatesSheet, 6, 0);      // 红门 - 第七行第1列（行索引6，列索引0）
+    // 只在建立某个尺寸的缓存时做一次平滑缩放
+    return sprite.scaled(size, size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+        .convertToFormat(QImage::Format_ARGB32_Premultiplied);
 }
 
-void ImageManager::loadEnemys()
+void ImageManager::uploadSheet(const SheetJob& job)
 {
-    // 加载敌人精灵图
-    enemysSheet = QPixmap(":/images/enemys.png");
-    if (enemysSheet.isNull()) {
-        qWarning() << "无法加载敌人精灵图: :/images/enemys.png";
+    if (job.images.isEmpty() && job.sheet.isNull()) {
+        qWarning().noquote() << QString("无法加载%1精灵图: %2").arg(job.name, job.path);
         return;
     }
-    
-    // 预切割并缓存怪物图片
-    entityCache["green_slime"] = cropSprite(enemysSheet, 0, 0);  // 绿史莱姆 - 第一行第一列
-    entityCache["red_slime"] = cropSprite(enemysSheet, 1, 0);     // 红史莱姆 - 第二行第一列
-    entityCache["black_slime"] = cropSprite(enemysSheet, 2, 0);   // 黑史莱姆 - 第三行第一列
-    entityCache["skeleton"] = cropSprite(enemysSheet, 9, 0);      // 骷髅 - 第十行第一列
+    for (int i = 0; i < job.crops.size(); ++i) {
+        const SpriteCrop& crop = job.crops[i];
+        QPixmap pixmap = QPixmap::fromImage(job.images[i]);
+        switch (crop.target) {
+            case SpriteCrop::Frame: spriteCache.frames[crop.key] = pixmap; break;
+            case SpriteCrop::Floor: spriteCache.floor[crop.key] = pixmap; break;
+            case SpriteCrop::Hero: spriteCache.hero[crop.key] = pixmap; break;
+        }
+        sourceImages[sourceIndex(crop.target, crop.key)] = job.images[i];
+    }
+    if (job.keepSheet) {
+        spriteCache.lack = QPixmap::fromImage(job.sheet);
+        sourceImages.last() = job.sheet;
+    }
 }
 
-void ImageManager::loadItems()
+int ImageManager::sourceIndex(SpriteCrop::Target target, int key) const
 {
-    // 加载物品精灵图
-    itemsSheet = QPixmap(":/images/items.png");
-    if (itemsSheet.isNull()) {
-        qWarning() << "无法加载物品精灵图: :/images/items.png";
-        return;
+    switch (target) {
+        case SpriteCrop::Frame: return key;
+        case SpriteCrop::Floor: return spriteCache.frames.size() + key;
+        case SpriteCrop::Hero: return spriteCache.frames.size() + spriteCache.floor.size() + key;
     }
+    return key;
+}
+
+ImageManager::SheetJob ImageManager::heroJob() const
+{
+    SheetJob job;
+    job.path = ":/images/brave.png";
+    job.name = "英雄";
     
-    // 预切割并缓存物品图片（多行1列结构）
-    entityCache["yellow_key"] = cropSprite(itemsSheet, 0, 0);    // 黄钥匙 - 第一行
-    entityCache["blue_key"] = cropSprite(itemsSheet, 1, 0);       // 蓝钥匙 - 第二行
-    entityCache["red_key"] = cropSprite(itemsSheet, 2, 0);        // 红钥匙 - 第三行
-    entityCache["atk_gem"] = cropSprite(itemsSheet, 16, 0);        // 攻击宝石 - 第十七行
-    entityCache["def_gem"] = cropSprite(itemsSheet, 17, 0);        // 防御宝石 - 第十八行
-    entityCache["hp_potion_1"] = cropSprite(itemsSheet, 20, 0);    // 生命药水1 - 第二十一行
-    entityCache["hp_potion_2"] = cropSprite(itemsSheet, 21, 0);    // 生命药水2 - 第二十二行
-    entityCache["hp_potion_3"] = cropSprite(itemsSheet, 22, 0);    // 生命药水3 - 第二十三行
+    // 预切割并缓存所有英雄帧 (4行4列)
+    for (int face = 0; face < 4; ++face) {
+        for (int frame = 0; frame < 4; ++frame) {
+            int key = face * 4 + frame;
+            job.crops.append({SpriteCrop::Hero, key, {face, frame}});
+        }
+    }
+    return job;
 }
 
-QPixmap ImageManager::cropSprite(const QPixmap& spriteSheet, int row, int col) const
+ImageManager::SheetJob ImageManager::lackResourceJob() const
+{
+    // 缺失材质整张使用，不切割
+    SheetJob job;
+    job.path = ":/images/lack_resource.png";
+    job.name = "缺失材质";
+    job.keepSheet = true;
+    return job;
+}
+
+QImage ImageManager::cropSprite(const QImage& spriteSheet, int row, int col)
 {
     int x = col * SPRITE_SIZE;
     int y = row * SPRITE_SIZE;
     return spriteSheet.copy(x, y, SPRITE_SIZE, SPRITE_SIZE);
 }
 
-QPixmap ImageManager::getEntityImage(const QString& entityId) const
+SpriteHandle ImageManager::findSprite(const QString& entityId) const
 {
     // 先尝试直接查找
-    if (entityCache.contains(entityId)) {
-        return entityCache[entityId];
+    auto exact = spriteIds.constFind(entityId);
+    if (exact != spriteIds.constEnd()) {
+        return exact.value();
     }
     
-    // 尝试通过前缀匹配
-    for (auto it = entityCache.begin(); it != entityCache.end(); ++it) {
-        if (entityId.startsWith(it.key())) {
-            return it.value();
+    // 尝试通过前缀匹配，取最长的前缀
+    SpriteHandle best = LACK_SPRITE;
+    int bestLength = 0;
+    for (auto it = spriteIds.constBegin(); it != spriteIds.constEnd(); ++it) {
+        if (it.key().size() > bestLength && entityId.startsWith(it.key())) {
+            best = it.value();
+            bestLength = it.key().size();
         }
     }
     
-    // 无法找到材质，使用缺失材质替代
-    return lackResource;
+    // 无法找到材质时为LACK_SPRITE，绘制缺失材质
+    return best;
+}
+
+int ImageManager::getFrameCount(SpriteHandle sprite) const
+{
+    return sprite > 0 && sprite < sprites.size() ? sprites[sprite].frameCount : 1;
+}
+
+const QPixmap& ImageManager::getSpriteImage(SpriteHandle sprite, int frame) const
+{
+    return spriteFrame(spriteCache, sprite, frame);
+}
+
+const QPixmap& ImageManager::getFloorImage(int floorId) const
+{
+    return findFloor(spriteCache, floorId);
+}
+
+const QPixmap& ImageManager::getHeroImage(int face, int frame) const
+{
+    return findHero(spriteCache, face, frame);
+}
+
+const QPixmap& ImageManager::getSpriteTile(SpriteHandle sprite, int frame) const
+{
+    return spriteFrame(tileCache->tiles, sprite, frame);
+}
+
+const QPixmap& ImageManager::getFloorTile(int floorId) const
+{
+    return findFloor(tileCache->tiles, floorId);
 }
 
-QPixmap ImageManager::getFloorImage(int floorId) const
+const QPixmap& ImageManager::getHeroTile(int face, int frame) const
 {
-    if (floorCache.contains(floorId)) {
-        return floorCache[floorId];
+    return findHero(tileCache->tiles, face, frame);
+}
+
+const QPixmap& ImageManager::spriteFrame(const SpriteSet& set, SpriteHandle sprite, int frame) const
+{
+    if (sprite <= LACK_SPRITE || sprite >= sprites.size()) {
+        return set.lack;
+    }
+    const SpriteEntry& entry = sprites[sprite];
+    const QPixmap& image = set.frames[entry.firstFrame + frame % entry.frameCount];
+    return image.isNull() ? set.lack : image;
+}
+
+const QPixmap& ImageManager::findFloor(const SpriteSet& set, int floorId)
+{
+    if (floorId >= 0 && floorId < set.floor.size() && !set.floor[floorId].isNull()) {
+        return set.floor[floorId];
     }
     // 默认返回地板0，如果地板0不存在则使用缺失材质
-    QPixmap floorImage = floorCache.value(0);
-    return floorImage.isNull() ? lackResource : floorImage;
+    return set.floor.isEmpty() || set.floor[0].isNull() ? set.lack : set.floor[0];
 }
 
-QPixmap ImageManager::getHeroImage(int face, int frame) const
+const QPixmap& ImageManager::findHero(const SpriteSet& set, int face, int frame)
 {
     // 将游戏中的face转换为精灵图的行
     // 游戏: 0=左, 1=上, 2=右, 3=下
@@ -155,15 +439,8 @@ QPixmap ImageManager::getHeroImage(int face, int frame) const
     }
     
     int key = spriteRow * 4 + (frame % 4);
-    QPixmap heroImage = heroCache.value(key);
-    return heroImage.isNull() ? lackResource : heroImage;
-}
-
-void ImageManager::loadLackResource()
-{
-    // 加载缺失材质
-    lackResource = QPixmap(":/images/lack_resource.png");
-    if (lackResource.isNull()) {
-        qFatal("无法加载缺失材质: :/images/lack_resource.png");
+    if (key < set.hero.size() && !set.hero[key].isNull()) {
+        return set.hero[key];
     }
+    return set.lack;
 }
@@ -3,8 +3,14 @@
 //====================
 #pragma once
 #include <QPixmap>
+#include <QImage>
+#include <QHash>
 #include <QMap>
 #include <QString>
+#include <QVector>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <memory>
 
 // 精灵图切割信息
 struct SpriteInfo {
@@ -12,70 +18,159 @@ struct SpriteInfo {
     int col;    // 列索引（从0开始）
 };
 
+// 精灵句柄：精灵清单中一个精灵的下标，0表示缺失材质
+using SpriteHandle = int;
+const SpriteHandle LACK_SPRITE = 0;
+
 class ImageManager
 {
 public:
-    // 加载所有资源
-    void loadResources();
-    
-    // 获取实体图片（根据实体ID）
-    QPixmap getEntityImage(const QString& entityId) const;
-    
+    // 加载所有资源，并为格子大小tileSize与设备像素比dpr预先缩放一份绘制用图片
+    // manifestPath为精灵清单文件（gamedata/sprites.txt）
+    void loadResources(int tileSize, const QString& manifestPath, qreal dpr = 1.0);
+
+    // 切换绘制用图片的格子大小（逻辑像素）与设备像素比
+    // 该尺寸已缓存或已在后台缩放时直接取用，否则立即在线程池中并行缩放
+    void setTileScale(int tileSize, qreal dpr);
+    // 在后台线程预先缩放一个尺寸，之后切换到该尺寸时不需要等待
+    void prepareTileScale(int tileSize, qreal dpr);
+    // 该尺寸的缩放是否已经完成，完成后setTileScale只需上传、不会等待
+    bool isTileScaleReady(int tileSize, qreal dpr) const;
+    // 各尺寸缓存的内存上限（字节），超出时换出最久未使用的尺寸，当前尺寸不会被换出
+    void setCacheBudget(qint64 bytes) { cacheBudget = bytes; }
+
+    // 为实体ID查找精灵句柄：先精确匹配，再按最长前缀匹配，都不匹配时返回LACK_SPRITE
+    // 应在加载时对每个实体调用一次，绘制时只使用句柄
+    SpriteHandle findSprite(const QString& entityId) const;
+    // 精灵的动画帧数
+    int getFrameCount(SpriteHandle sprite) const;
+
+    // 获取精灵图片（原始尺寸），frame按帧数取模
+    const QPixmap& getSpriteImage(SpriteHandle sprite, int frame = 0) const;
+
     // 获取地板图片（根据地板ID）
-    QPixmap getFloorImage(int floorId) const;
-    
+    const QPixmap& getFloorImage(int floorId) const;
+
     // 获取英雄图片（根据朝向和动画帧）
     // face: 0=下, 1=左, 2=右, 3=上 (brave.png的行顺序)
     // frame: 0-3 动画帧
-    QPixmap getHeroImage(int face, int frame = 0) const;
-    
+    const QPixmap& getHeroImage(int face, int frame = 0) const;
+
+    // 以下返回已缩放到getTileSize()*getTileDpr()物理像素的图片，并带有对应的设备像素比，
+    // 绘制时按逻辑像素1:1贴图，不需要再缩放
+    const QPixmap& getSpriteTile(SpriteHandle sprite, int frame = 0) const;
+    const QPixmap& getFloorTile(int floorId) const;
+    const QPixmap& getHeroTile(int face, int frame = 0) const;
+    int getTileSize() const { return tileSize; }
+    qreal getTileDpr() const { return tileDpr; }
+
     // 原始精灵图尺寸
     static const int SPRITE_SIZE = 32;
 
 private:
+    // 精灵清单中的一个精灵，各帧在SpriteSet::frames中连续存放
+    struct SpriteEntry {
+        QString id;
+        int firstFrame;
+        int frameCount;
+    };
+
+    // 精灵图中要切割的一格及其存放位置
+    struct SpriteCrop {
+        enum Target { Frame, Floor, Hero } target;
+        int key;            // 在对应数组中的下标
+        SpriteInfo pos;
+    };
+
+    // 一张精灵图的加载任务：解码与切割在线程池中完成，结果为QImage
+    struct SheetJob {
+        QString path;
+        QString name;
+        QVector<SpriteCrop> crops;
+        bool keepSheet = false;     // 整张图本身也是一个图片（缺失材质）
+        QImage sheet;
+        QVector<QImage> images;     // 与crops一一对应
+    };
+
+    // 一组同尺寸的图片缓存，全部按下标访问
+    struct SpriteSet {
+        // 精灵清单中各精灵的全部帧
+        QVector<QPixmap> frames;
+        // 地板ID到图片的映射
+        QVector<QPixmap> floor;
+        // 英雄图片 (face * 4 + frame)
+        QVector<QPixmap> hero;
+        // 缺失材质
+        QPixmap lack;
+    };
+
+    // 一个(格子大小, 设备像素比)的缩放缓存
+    struct ScaledSet {
+        int tileSize = 0;
+        qreal dpr = 1.0;
+        SpriteSet tiles;            // 上传后的图片，缩放完成前为空
+        QVector<QImage> images;     // 缩放结果，与sourceImages一一对应，上传后清空
+        QSemaphore finished;        // 每个缩放任务完成时释放一次
+        int taskCount = 0;
+        bool uploaded = false;
+        qint64 bytes = 0;
+        quint64 lastUse = 0;
+    };
+
+    // 解码并切割一张精灵图，可在任意线程调用
+    static void decodeSheet(SheetJob& job);
+    // 把图片缩放到size×size
+    static QImage scaleSprite(const QImage& sprite, int size);
+
     // 从精灵图切割单个图片
-    QPixmap cropSprite(const QPixmap& spriteSheet, int row, int col) const;
-    
-    // 加载地形精灵图
-    void loadTerrains();
-    
-    // 加载动画精灵图
-    void loadAnimates();
-    
-    // 加载敌人精灵图
-    void loadEnemys();
-    
-    // 加载物品精灵图
-    void loadItems();
-    
-    // 加载英雄精灵图
-    void loadHero();
-    
-    // 加载缺失材质
-    void loadLackResource();
-    
-    // 地形精灵图
-    QPixmap terrainsSheet;
-    // 动画精灵图
-    QPixmap animatesSheet;
-    // 敌人精灵图
-    QPixmap enemysSheet;
-    // 英雄精灵图
-    QPixmap heroSheet;
-    // 物品精灵图
-    QPixmap itemsSheet;
-    // 缺失材质
-    QPixmap lackResource;
-    
-    // 实体ID到精灵图位置的映射
-    QMap<QString, SpriteInfo> entitySpriteMap;
+    static QImage cropSprite(const QImage& spriteSheet, int row, int col);
+
+    // 读取精灵清单，按精灵图分组生成切割任务
+    void loadManifest(const QString& manifestPath, QMap<QString, SheetJob>& sheetJobs);
+    // 地板与英雄的切割任务
+    void addFloorCrops(SheetJob& job);
+    SheetJob heroJob() const;
+    SheetJob lackResourceJob() const;
+
+    // 在GUI线程把切割结果上传为QPixmap并放入原始尺寸缓存，同时保留QImage供缩放
+    void uploadSheet(const SheetJob& job);
+    // 图片在sourceImages中的下标：依次为全部帧、地板、英雄，最后一个为缺失材质
+    int sourceIndex(SpriteCrop::Target target, int key) const;
+
+    // 在线程池中把全部原始图片缩放到一个尺寸，返回尚未上传的缓存
+    // 立即需要的尺寸以较高优先级排队，先于后台预备的尺寸执行
+    std::shared_ptr<ScaledSet> startScale(int tileSize, qreal dpr, int priority);
+    // 只等待这一尺寸的缩放任务完成，并在GUI线程上传为QPixmap
+    void uploadScaled(ScaledSet& set);
+    // 缓存总量超过上限时按最久未使用换出
+    void trimCaches();
+    static quint64 scaleKey(int tileSize, qreal dpr);
+
+    // 在缓存中按下标取图片，缺失时返回缺失材质
+    const QPixmap& spriteFrame(const SpriteSet& set, SpriteHandle sprite, int frame) const;
+    static const QPixmap& findFloor(const SpriteSet& set, int floorId);
+    static const QPixmap& findHero(const SpriteSet& set, int face, int frame);
+
+    // 精灵清单，下标为精灵句柄，0号为缺失材质
+    QVector<SpriteEntry> sprites;
+    // 实体ID到精灵句柄的映射（只在加载时查找）
+    QHash<QString, SpriteHandle> spriteIds;
     // 地板ID到精灵图位置的映射
     QMap<int, SpriteInfo> floorSpriteMap;
-    
-    // 预切割的实体图片缓存
-    QMap<QString, QPixmap> entityCache;
-    // 预切割的地板图片缓存
-    QMap<int, QPixmap> floorCache;
-    // 预切割的英雄图片缓存 (face * 4 + frame)
-    QMap<int, QPixmap> heroCache;
+
+    // 预切割的原始尺寸图片
+    SpriteSet spriteCache;
+    // 原始尺寸图片的QImage版本，可在线程池中读取
+    QVector<QImage> sourceImages;
+
+    // 各尺寸的缩放缓存，按需建立；图片由QPixmap::fromImage转换为设备的原生像素格式
+    QHash<quint64, std::shared_ptr<ScaledSet>> scaledSets;
+    std::shared_ptr<ScaledSet> tileCache;   // 当前绘制使用的尺寸
+    int tileSize = SPRITE_SIZE;
+    qreal tileDpr = 1.0;
+    qint64 cacheBudget = qint64(64) << 20;
+    quint64 useClock = 0;
+
+    // 缩放用的线程池，放在最后以便析构时先等待后台任务结束
+    QThreadPool scalePool;
 };
@@ -4,29 +4,40 @@
 #pragma once
 #include <QVector>
 #include <QString>
+#include <functional>
+#include "Entity.h"
 
-//地图块结构
+//地图块结构（4字节POD，整层连续存放）
 class Block
 {
 public:
-    int floorId;
-    QString entityId;
+    EntityHandle entity = AIR_HANDLE;   //实体句柄，通过Data::getEntity/getEntityId解析
+    quint16 floorId = 0;
 };
 
 //层结构
+//所有格子按行优先存放在一块连续内存中：下标 = y * len + x
+//楼层按需加载，未加载时tiles为空
 class Floor
 {
 public:
-    Floor(int length,int width)
-    {
-        floor.resize(length); // X轴方向（列数）
-        for (int i = 0; i < length; ++i)
-        {
-            floor[i].resize(width); // Y轴方向（行数）
-        }
-    }
-    Block& getBlock(int x,int y){return floor[x][y];}
-    QVector<QVector<Block>> floor;
+    Floor(int length,int width) : len(length),wid(width){}
+
+    bool isLoaded() const {return !tiles.isEmpty();}
+    void allocate(){tiles = QVector<Block>(len * wid);}
+    void release(){tiles = QVector<Block>();}
+
+    Block& getBlock(int x,int y){return tiles[y * len + x];}
+    const Block& getBlock(int x,int y) const {return tiles[y * len + x];}
+
+    //第y行的首个格子，该行len个格子连续存放
+    Block* row(int y){return tiles.data() + y * len;}
+    const Block* row(int y) const {return tiles.constData() + y * len;}
+
+    int len;    // X轴方向（列数）
+    int wid;    // Y轴方向（行数）
+    QVector<Block> tiles;
+    quint64 lastUse = 0;    //最近一次访问的时刻（Map::useClock），用于换出最久未用的楼层
 };
 
 //地图管理器
@@ -41,9 +52,19 @@ public:
         }
     }
 
-    Floor& getFloor(int layer){return map[layer];}
+    //访问未加载的楼层时先通过loader加载
+    Floor& getFloor(int layer)
+    {
+        Floor& floor = map[layer];
+        if (!floor.isLoaded() && loader)
+            loader(layer);
+        floor.lastUse = ++useClock;
+        return floor;
+    }
 
     QVector<Floor> map;
+    std::function<void(int layer)> loader;
+    quint64 useClock = 0;
     int len;
     int wid;
     int layers;
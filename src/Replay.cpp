@@ -0,0 +1,101 @@
+#include "Replay.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+
+static const char REPLAY_MAGIC[4] = {'M', 'R', 'P', 'L'};
+static const quint32 REPLAY_VERSION = 1;
+static const int HEADER_SIZE = 4 + 4 + 8 + 8 + 4;
+
+void Replay::save(const QString& filePath) const
+{
+    QByteArray out(HEADER_SIZE + (actions.size() + 3) / 4, '\0');
+    char* data = out.data();
+    std::memcpy(data, REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+    qToLittleEndian<quint32>(REPLAY_VERSION, data + 4);
+    qToLittleEndian<quint64>(towerHash, data + 8);
+    qToLittleEndian<quint64>(finalHash, data + 16);
+    qToLittleEndian<quint32>(actions.size(), data + 24);
+
+    //方向占2位，None不会出现在录像中
+    uchar* packed = reinterpret_cast<uchar*>(data + HEADER_SIZE);
+    for (int i = 0; i < actions.size(); ++i)
+    {
+        if (actions[i] == InputAction::None)
+            throw QString("录像中不能包含空输入");
+        int code = static_cast<int>(actions[i]) - 1;
+        packed[i / 4] |= code << (2 * (i % 4));
+    }
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        throw QString("无法写入录像文件:" + filePath);
+    file.write(out);
+    if (!file.commit())
+        throw QString("无法写入录像文件:" + filePath);
+}
+
+Replay Replay::load(const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        throw QString("无法打开录像文件:" + filePath);
+    QByteArray in = file.readAll();
+    const char* data = in.constData();
+    if (in.size() < HEADER_SIZE || std::memcmp(data, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) != 0)
+        throw QString("不是录像文件:" + filePath);
+    if (qFromLittleEndian<quint32>(data + 4) != REPLAY_VERSION)
+        throw QString("录像文件版本不受支持:" + filePath);
+
+    Replay replay;
+    replay.towerHash = qFromLittleEndian<quint64>(data + 8);
+    replay.finalHash = qFromLittleEndian<quint64>(data + 16);
+    const quint32 count = qFromLittleEndian<quint32>(data + 24);
+    if ((in.size() - HEADER_SIZE) < (qint64(count) + 3) / 4)
+        throw QString("录像文件已损坏:" + filePath);
+
+    const uchar* packed = reinterpret_cast<const uchar*>(data + HEADER_SIZE);
+    replay.actions.resize(count);
+    for (quint32 i = 0; i < count; ++i)
+    {
+        int code = (packed[i / 4] >> (2 * (i % 4))) & 3;
+        replay.actions[i] = static_cast<InputAction>(code + 1);
+    }
+    return replay;
+}
+
+ReplayResult runReplay(Game& game, const Replay& replay)
+{
+    ReplayResult result;
+    result.towerMatched = game.getGameData()->getContentHash() == replay.towerHash;
+
+    //结局信号在提交变化时同步发出
+    bool ended = false;
+    QMetaObject::Connection overConnection = QObject::connect(&game, &Game::gameOver, [&]() {
+        result.gameOver = true;
+        ended = true;
+    });
+    QMetaObject::Connection successConnection = QObject::connect(&game, &Game::gameSuccess, [&]() {
+        result.success = true;
+        ended = true;
+    });
+
+    for (InputAction action : replay.actions)
+    {
+        game.handleInput(action);
+        ++result.executed;
+        if (ended)
+            break;
+    }
+    QObject::disconnect(overConnection);
+    QObject::disconnect(successConnection);
+
+    result.stoppedEarly = result.executed < replay.actions.size();
+    result.finalHash = game.stateHash();
+    result.finalMatched = result.finalHash == replay.finalHash;
+    if (auto hero = game.getGameData()->getHeroData())
+        result.hero = *hero;
+    result.floor = game.getCurrentFloor();
+    return result;
+}
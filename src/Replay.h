@@ -0,0 +1,41 @@
+//====================
+//输入录像与无界面回放
+//====================
+#pragma once
+#include <QString>
+#include <QVector>
+#include "game.h"
+
+//一段录像：塔内容哈希、录制结束时的状态哈希与输入序列
+//只记录产生过状态变化的输入，不改变状态的输入在回放中同样不改变状态，省略不影响结果
+struct Replay
+{
+    quint64 towerHash = 0;      //录制时Data::getContentHash()
+    quint64 finalHash = 0;      //录制结束时Game::stateHash()
+    QVector<InputAction> actions;
+
+    //文件格式（小端）：magic "MRPL"、quint32版本、quint64 towerHash、quint64 finalHash、
+    //quint32输入数，之后每个输入2位（方向-1），每字节4个，低位在前
+    void save(const QString& filePath) const;
+    static Replay load(const QString& filePath);
+};
+
+//回放结果
+struct ReplayResult
+{
+    int executed = 0;           //实际执行的输入数
+    bool towerMatched = false;  //塔内容与录制时一致
+    bool finalMatched = false;  //最终状态与录制时一致
+    bool gameOver = false;
+    bool success = false;
+    bool stoppedEarly = false;  //输入未执行完游戏就已结束
+    quint64 finalHash = 0;
+    HeroState hero;
+    int floor = 0;
+
+    bool diverged() const { return !towerMatched || !finalMatched || stoppedEarly; }
+};
+
+//在game的当前状态（应为塔的初始状态）上依次执行录像中的输入，不经过界面。
+//游戏结束或胜利后停止执行
+ReplayResult runReplay(Game& game, const Replay& replay);
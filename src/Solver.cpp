@@ -0,0 +1,545 @@
+#include "Solver.h"
+#include "Zobrist.h"
+#include <QHash>
+#include <QThread>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <deque>
+#include <utility>
+
+//====================
+//辅助函数
+//====================
+
+//a的各项属性与钥匙都不少于b
+static bool dominates(const HeroState& a, const HeroState& b)
+{
+    return a.hp >= b.hp && a.atk >= b.atk && a.def >= b.def && a.gold >= b.gold
+        && a.yellow_key >= b.yellow_key && a.blue_key >= b.blue_key && a.red_key >= b.red_key;
+}
+
+//====================
+//已访问状态表
+//====================
+//按(楼层,位置,已清除集合)分组，每组保存互不支配的勇者属性集合；
+//按键的哈希分片加锁，减少线程间竞争
+class Solver::VisitedTable
+{
+public:
+    //state未被同组已有状态支配时登记并返回true
+    bool tryInsert(const SearchState& state)
+    {
+        quint64 key = mix64((quint64(quint32(state.layer)) << 32) | quint32(state.pos));
+        for (quint64 word : state.removed)
+            key = mix64(key ^ word);
+
+        Shard& shard = shards[key % SHARD_COUNT];
+        QMutexLocker locker(&shard.mutex);
+        QVector<Entry>& bucket = shard.entries[key];
+        for (Entry& entry : bucket)
+        {
+            if (entry.layer != state.layer || entry.pos != state.pos || entry.removed != state.removed)
+                continue;
+            for (const HeroState& other : std::as_const(entry.front))
+            {
+                if (dominates(other, state.hero))
+                    return false;
+            }
+            //删除被新状态支配的旧状态
+            entry.front.erase(std::remove_if(entry.front.begin(), entry.front.end(),
+                [&state](const HeroState& other) { return dominates(state.hero, other); }),
+                entry.front.end());
+            entry.front.append(state.hero);
+            return true;
+        }
+        Entry entry;
+        entry.layer = state.layer;
+        entry.pos = state.pos;
+        entry.removed = state.removed;
+        entry.front.append(state.hero);
+        bucket.append(entry);
+        return true;
+    }
+
+private:
+    struct Entry
+    {
+        int layer;
+        int pos;
+        QVector<quint64> removed;
+        QVector<HeroState> front;
+    };
+
+    struct Shard
+    {
+        QMutex mutex;
+        QHash<quint64, QVector<Entry>> entries;
+    };
+
+    static const int SHARD_COUNT = 64;
+    Shard shards[SHARD_COUNT];
+};
+
+//====================
+//工作线程数据
+//====================
+
+//连通区域计算的临时缓冲，每个线程一份，避免重复分配
+struct Solver::Scratch
+{
+    QVector<quint32> mark;      //层内格子的访问标记
+    quint32 stamp = 0;          //本次计算的标记值，递增代替清空
+    QVector<int> stack;
+    QVector<int> region;        //连通区域（层内下标）
+    QVector<int> frontier;      //区域边界上未清除的可清除格子（全塔下标）
+    QVector<int> stairs;        //可进入的楼梯（全塔下标）
+};
+
+struct Solver::Worker
+{
+    QMutex mutex;
+    std::deque<SearchState> deque;
+    Scratch scratch;
+};
+
+//====================
+//Solver
+//====================
+
+Solver::Solver(Data* data, int startFloor)
+    : gameData(data)
+    , layers(data->map.layers)
+    , len(data->map.len)
+    , wid(data->map.wid)
+    , floorSize(data->map.len * data->map.wid)
+    , startFloor(startFloor)
+    , removableWords(0)
+    , maxStates(0)
+    , hasBest(false)
+{
+    if (auto hero = data->getHeroData())
+        startHero = *hero;
+
+    //把地图转换为静态格子类型，可清除格子依次编号
+    int total = layers * floorSize;
+    tileType.fill(TileType::Blocked, total);
+    tileHandle.fill(AIR_HANDLE, total);
+    removableBit.fill(-1, total);
+    stairTarget.fill(-1, total);
+    int bits = 0;
+    for (int layer = 0; layer < layers; ++layer)
+    {
+        Floor& floor = data->map.getFloor(layer);
+        for (int y = 0; y < wid; ++y)
+        {
+            const Block* row = floor.row(y);
+            for (int x = 0; x < len; ++x)
+            {
+                int tile = tileIndex(layer, y * len + x);
+                EntityHandle handle = row[x].entity;
+                tileHandle[tile] = handle;
+                switch (data->getKind(handle))
+                {
+                case EntityKind::Air:
+                    tileType[tile] = TileType::Open;
+                    break;
+                case EntityKind::Item:
+                case EntityKind::Door:
+                case EntityKind::Monster:
+                    tileType[tile] = TileType::Removable;
+                    removableBit[tile] = bits++;
+                    break;
+                case EntityKind::Stair:
+                {
+                    tileType[tile] = TileType::Stair;
+                    int offset = data->getStairOffset(handle);
+                    int target = layer + offset;
+                    if (offset > 0 && target >= layers)
+                    {
+                        stairTarget[tile] = -2;
+                    }
+                    else if (offset != 0 && target >= 0)
+                    {
+                        //与Game::handleStairInteraction一致：落在对应楼梯上，找不到时保持原坐标
+                        QPoint pos = data->findStair(target, -offset);
+                        if (pos == QPoint(-1, -1))
+                            pos = QPoint(x, y);
+                        stairTarget[tile] = tileIndex(target, pos.y() * len + pos.x());
+                    }
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+        }
+    }
+    removableWords = (bits + 63) / 64;
+}
+
+Solver::~Solver()
+{
+    qDeleteAll(workers);
+}
+
+bool Solver::better(const HeroState& a, const HeroState& b)
+{
+    return a.hp > b.hp || (a.hp == b.hp && a.gold > b.gold);
+}
+
+bool Solver::isRemoved(const SearchState& state, int tile) const
+{
+    int bit = removableBit[tile];
+    return (state.removed[bit >> 6] >> (bit & 63)) & 1;
+}
+
+void Solver::flood(const SearchState& state, Scratch& scratch) const
+{
+    if (++scratch.stamp == 0)
+    {
+        scratch.mark.fill(0);
+        scratch.stamp = 1;
+    }
+    const quint32 stamp = scratch.stamp;
+    const int base = state.layer * floorSize;
+    scratch.stack.clear();
+    scratch.region.clear();
+    scratch.frontier.clear();
+    scratch.stairs.clear();
+
+    scratch.mark[state.pos] = stamp;
+    scratch.stack.append(state.pos);
+    while (!scratch.stack.isEmpty())
+    {
+        int pos = scratch.stack.takeLast();
+        scratch.region.append(pos);
+        int x = pos % len;
+        int y = pos / len;
+        const int neighbors[4][2] = {{x - 1, y}, {x + 1, y}, {x, y - 1}, {x, y + 1}};
+        for (const auto& n : neighbors)
+        {
+            if (n[0] < 0 || n[0] >= len || n[1] < 0 || n[1] >= wid)
+                continue;
+            int npos = n[1] * len + n[0];
+            if (scratch.mark[npos] == stamp)
+                continue;
+            scratch.mark[npos] = stamp;
+            int tile = base + npos;
+            switch (tileType[tile])
+            {
+            case TileType::Open:
+                scratch.stack.append(npos);
+                break;
+            case TileType::Removable:
+                if (isRemoved(state, tile))
+                    scratch.stack.append(npos);
+                else
+                    scratch.frontier.append(tile);
+                break;
+            case TileType::Stair:
+                scratch.stairs.append(tile);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    //站在楼梯上时，离开再踩回即可再次使用该楼梯
+    if (tileType[base + state.pos] == TileType::Stair && scratch.region.size() > 1)
+        scratch.stairs.append(base + state.pos);
+}
+
+bool Solver::isFree(const SearchState& state, int tile) const
+{
+    EntityHandle handle = tileHandle[tile];
+    switch (gameData->getKind(handle))
+    {
+    case EntityKind::Item:
+    {
+        const StatDelta& effect = gameData->getEffect(handle);
+        return effect.hp >= 0 && effect.atk >= 0 && effect.def >= 0 && effect.gold >= 0
+            && effect.yellow_key >= 0 && effect.blue_key >= 0 && effect.red_key >= 0;
+    }
+    case EntityKind::Monster:
+    {
+        const Monster& monster = static_cast<const Monster&>(*gameData->getEntity(handle));
+        BattleForecast battle = forecastBattle(state.hero.atk, state.hero.def, monster);
+        return battle.canBreak && battle.damage == 0;
+    }
+    default:
+        return false;
+    }
+}
+
+bool Solver::interact(SearchState& state, int tile) const
+{
+    //与Game::handle*Interaction使用相同的规则
+    EntityHandle handle = tileHandle[tile];
+    switch (gameData->getKind(handle))
+    {
+    case EntityKind::Item:
+        state.hero.apply(gameData->getEffect(handle));
+        if (state.hero.hp <= 0)
+            return false;
+        break;
+    case EntityKind::Door:
+    {
+        const StatDelta& cost = gameData->getEffect(handle);
+        if (!state.hero.canPay(cost))
+            return false;
+        state.hero.apply(cost, -1);
+        break;
+    }
+    case EntityKind::Monster:
+    {
+        const Monster& monster = static_cast<const Monster&>(*gameData->getEntity(handle));
+        BattleForecast battle = forecastBattle(state.hero.atk, state.hero.def, monster);
+        if (!battle.canDefeat(state.hero.hp))
+            return false;
+        state.hero.hp -= battle.damage;
+        state.hero.gold += monster.gold;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    int bit = removableBit[tile];
+    state.removed[bit >> 6] |= quint64(1) << (bit & 63);
+    state.path = std::make_shared<PathNode>(PathNode{state.path, tile});
+    return true;
+}
+
+void Solver::record(const SearchState& state, int stairTile)
+{
+    QMutexLocker locker(&bestMutex);
+    if (hasBest && !better(state.hero, bestHero))
+        return;
+    hasBest = true;
+    bestHero = state.hero;
+    int pos = stairTile % floorSize;
+    bestHero.posx = pos % len;
+    bestHero.posy = pos / len;
+    bestPath = std::make_shared<PathNode>(PathNode{state.path, stairTile});
+}
+
+void Solver::expand(SearchState& state, int workerId)
+{
+    Scratch& scratch = workers[workerId]->scratch;
+
+    //先执行所有只增不减的交互，直到区域不再变化
+    for (;;)
+    {
+        flood(state, scratch);
+        bool changed = false;
+        for (int tile : std::as_const(scratch.frontier))
+        {
+            if (isFree(state, tile))
+            {
+                interact(state, tile);
+                changed = true;
+            }
+        }
+        if (!changed)
+            break;
+    }
+
+    //区域内最小的格子下标作为勇者位置，同一区域内的不同站位视为同一状态
+    state.pos = *std::min_element(scratch.region.cbegin(), scratch.region.cend());
+
+    if (!visited->tryInsert(state))
+    {
+        prunedCount.fetchAndAddRelaxed(1);
+        return;
+    }
+    qint64 expanded = expandedCount.fetchAndAddRelaxed(1) + 1;
+    if (maxStates > 0 && expanded >= maxStates)
+    {
+        stopFlag.storeRelease(1);
+        wakeIdle(true);
+    }
+
+    //战斗、开门、拾取负面物品
+    for (int tile : std::as_const(scratch.frontier))
+    {
+        SearchState child = state;
+        if (interact(child, tile))
+            push(std::move(child), workerId);
+    }
+
+    //上下楼
+    for (int tile : std::as_const(scratch.stairs))
+    {
+        int target = stairTarget[tile];
+        if (target == -1)
+            continue;
+        if (target == -2)
+        {
+            record(state, tile);
+            continue;
+        }
+        SearchState child = state;
+        child.layer = target / floorSize;
+        child.pos = target % floorSize;
+        child.path = std::make_shared<PathNode>(PathNode{state.path, tile});
+        push(std::move(child), workerId);
+    }
+}
+
+void Solver::push(SearchState&& state, int workerId)
+{
+    pending.fetchAndAddOrdered(1);
+    {
+        Worker* worker = workers[workerId];
+        QMutexLocker locker(&worker->mutex);
+        worker->deque.push_back(std::move(state));
+    }
+    //入队后再检查空闲线程数，与workerLoop中先登记空闲再检查队列配合，不会漏掉唤醒
+    if (idleWorkers.loadAcquire() > 0)
+        wakeIdle(false);
+}
+
+bool Solver::hasQueuedWork()
+{
+    for (Worker* worker : std::as_const(workers))
+    {
+        QMutexLocker locker(&worker->mutex);
+        if (!worker->deque.empty())
+            return true;
+    }
+    return false;
+}
+
+void Solver::wakeIdle(bool all)
+{
+    QMutexLocker locker(&idleMutex);
+    if (all)
+        workAvailable.wakeAll();
+    else
+        workAvailable.wakeOne();
+}
+
+bool Solver::pop(SearchState& state, int workerId)
+{
+    //优先取自己队列的末尾（深度优先，内存占用小）
+    {
+        Worker* worker = workers[workerId];
+        QMutexLocker locker(&worker->mutex);
+        if (!worker->deque.empty())
+        {
+            state = std::move(worker->deque.back());
+            worker->deque.pop_back();
+            return true;
+        }
+    }
+
+    //否则从其他线程队列的头部窃取，靠近根的状态子树更大
+    for (int i = 1; i < workers.size(); ++i)
+    {
+        Worker* victim = workers[(workerId + i) % workers.size()];
+        QMutexLocker locker(&victim->mutex);
+        if (!victim->deque.empty())
+        {
+            state = std::move(victim->deque.front());
+            victim->deque.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Solver::workerLoop(int workerId)
+{
+    SearchState state;
+    while (!stopFlag.loadAcquire())
+    {
+        if (pop(state, workerId))
+        {
+            expand(state, workerId);
+            //子状态已入队后才减少计数，计数为0即全部完成
+            if (pending.fetchAndSubOrdered(1) == 1)
+                wakeIdle(true);
+        }
+        else if (pending.loadAcquire() == 0)
+        {
+            break;
+        }
+        else
+        {
+            //没有可窃取的状态时等待入队、完成或停止；持锁复查，检查与等待之间的唤醒不会丢失
+            QMutexLocker locker(&idleMutex);
+            idleWorkers.fetchAndAddOrdered(1);
+            if (!stopFlag.loadAcquire() && pending.loadAcquire() != 0 && !hasQueuedWork())
+                workAvailable.wait(&idleMutex);
+            idleWorkers.fetchAndSubOrdered(1);
+        }
+    }
+}
+
+SolverResult Solver::solve(const SolverOptions& options)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int threadCount = options.threads > 0 ? options.threads : QThread::idealThreadCount();
+    threadCount = qMax(1, threadCount);
+    maxStates = options.maxStates;
+
+    //重置运行时状态
+    visited.reset(new VisitedTable);
+    qDeleteAll(workers);
+    workers.clear();
+    for (int i = 0; i < threadCount; ++i)
+    {
+        Worker* worker = new Worker;
+        worker->scratch.mark.fill(0, floorSize);
+        workers.append(worker);
+    }
+    pending.storeRelease(0);
+    expandedCount.storeRelease(0);
+    prunedCount.storeRelease(0);
+    stopFlag.storeRelease(0);
+    idleWorkers.storeRelease(0);
+    hasBest = false;
+    bestPath.reset();
+
+    SearchState initial;
+    initial.layer = startFloor;
+    initial.pos = startHero.posy * len + startHero.posx;
+    initial.hero = startHero;
+    initial.removed.fill(0, removableWords);
+    push(std::move(initial), 0);
+
+    QVector<QThread*> threads;
+    for (int i = 0; i < threadCount; ++i)
+        threads.append(QThread::create([this, i]() { workerLoop(i); }));
+    for (QThread* thread : std::as_const(threads))
+        thread->start();
+    for (QThread* thread : std::as_const(threads))
+        thread->wait();
+    qDeleteAll(threads);
+
+    SolverResult result;
+    result.solved = hasBest;
+    result.truncated = stopFlag.loadAcquire() != 0;
+    result.hero = bestHero;
+    result.expanded = expandedCount.loadAcquire();
+    result.pruned = prunedCount.loadAcquire();
+    for (const PathNode* node = bestPath.get(); node; node = node->parent.get())
+    {
+        int layer = node->tile / floorSize;
+        int pos = node->tile % floorSize;
+        result.steps.append(SolverStep{layer, pos % len, pos / len, tileHandle[node->tile]});
+    }
+    std::reverse(result.steps.begin(), result.steps.end());
+
+    //释放搜索过程中的状态
+    visited.reset();
+    qDeleteAll(workers);
+    workers.clear();
+    bestPath.reset();
+
+    result.elapsedMs = timer.elapsed();
+    return result;
+}
@@ -0,0 +1,135 @@
+//====================
+//最优路线求解器
+//====================
+#pragma once
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+#include <memory>
+#include "DataManager.h"
+#include "Combat.h"
+
+//求解参数
+struct SolverOptions
+{
+    int threads = 0;            //工作线程数，<=0时使用QThread::idealThreadCount()
+    qint64 maxStates = 0;       //最多展开的状态数，<=0表示不限制
+};
+
+//路线中的一步：拾取物品、开门、战斗或走楼梯
+struct SolverStep
+{
+    int layer;
+    int x;
+    int y;
+    EntityHandle handle;
+};
+
+//求解结果
+struct SolverResult
+{
+    bool solved = false;        //是否找到离开顶层的路线
+    bool truncated = false;     //是否因达到maxStates提前停止（结果不保证最优）
+    HeroState hero;             //离开顶层时的勇者状态
+    QVector<SolverStep> steps;  //按顺序执行的交互
+    qint64 expanded = 0;        //展开的状态数
+    qint64 pruned = 0;          //被支配剪枝的状态数
+    qint64 elapsedMs = 0;
+};
+
+//在Data的状态模型上搜索从当前位置到离开顶层、最终hp最高（gold次之）的交互顺序。
+//勇者在当前连通区域内的移动不计入状态，只有交互（战斗、拾取、开门、上下楼）产生新状态；
+//对勇者只增不减的物品和零伤害怪物会被立即处理。
+//同一楼层、同一连通区域、同一已清除集合下，各项属性与钥匙都不优于已有状态的状态被剪枝。
+//状态在各线程的双端队列间以工作窃取方式分配。
+class Solver
+{
+public:
+    //根据data的当前地图与勇者状态建立搜索模型，startFloor为勇者所在楼层
+    Solver(Data* data, int startFloor);
+    ~Solver();
+
+    SolverResult solve(const SolverOptions& options);
+
+private:
+    //格子的静态类型
+    enum class TileType : quint8 { Blocked, Open, Removable, Stair };
+
+    //路线链表节点，子状态共享父状态的路线前缀
+    struct PathNode
+    {
+        std::shared_ptr<const PathNode> parent;
+        int tile;   //全塔格子下标
+    };
+
+    //搜索状态
+    struct SearchState
+    {
+        int layer = 0;
+        int pos = 0;                //层内格子下标
+        HeroState hero;
+        QVector<quint64> removed;   //已清除的可清除格子位集
+        std::shared_ptr<const PathNode> path;
+    };
+
+    class VisitedTable;
+    struct Worker;
+    struct Scratch;
+
+    //全塔格子下标
+    int tileIndex(int layer, int pos) const { return layer * floorSize + pos; }
+    bool isRemoved(const SearchState& state, int tile) const;
+    //状态的当前连通区域及其边界上的可交互格子
+    void flood(const SearchState& state, Scratch& scratch) const;
+    //对可清除格子执行交互，失败（钥匙不足、打不过等）时返回false
+    bool interact(SearchState& state, int tile) const;
+    //对勇者只增不减的交互
+    bool isFree(const SearchState& state, int tile) const;
+
+    void expand(SearchState& state, int workerId);
+    void push(SearchState&& state, int workerId);
+    bool pop(SearchState& state, int workerId);
+    //是否还有线程队列非空
+    bool hasQueuedWork();
+    //唤醒等待任务的空闲线程：入队时唤醒一个，搜索结束或停止时唤醒全部
+    void wakeIdle(bool all);
+    void workerLoop(int workerId);
+    void record(const SearchState& state, int stairTile);
+
+    //离开顶层的结果是否优于当前最优
+    static bool better(const HeroState& a, const HeroState& b);
+
+    Data* gameData;
+    int layers;
+    int len;
+    int wid;
+    int floorSize;
+    int startFloor;
+    HeroState startHero;
+
+    //静态地图模型（全塔格子下标）
+    QVector<TileType> tileType;
+    QVector<EntityHandle> tileHandle;
+    QVector<int> removableBit;  //可清除格子的位下标，其他为-1
+    QVector<int> stairTarget;   //楼梯到达的全塔格子下标，-1不可用，-2离开顶层
+    int removableWords;
+
+    //搜索运行时
+    std::unique_ptr<VisitedTable> visited;
+    QVector<Worker*> workers;
+    QAtomicInteger<qint64> pending;
+    QAtomicInteger<qint64> expandedCount;
+    QAtomicInteger<qint64> prunedCount;
+    QAtomicInt stopFlag;
+    //没有任务可取的线程在此等待，不空转
+    QMutex idleMutex;
+    QWaitCondition workAvailable;
+    QAtomicInt idleWorkers;
+    qint64 maxStates;
+
+    QMutex bestMutex;
+    bool hasBest;
+    HeroState bestHero;
+    std::shared_ptr<const PathNode> bestPath;
+};
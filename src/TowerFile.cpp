@@ -0,0 +1,377 @@
+//====================
+//二进制塔文件
+//====================
+//文本地图与实体文件仍是编辑格式，发布时由mota-pack编译为一个二进制塔文件，
+//加载时直接映射文件，实体表逐项读取；文件在Data的生命周期内保持映射，
+//楼层首次访问时从格子平面整层拷贝，几乎不需要解析。
+//
+//所有整数均为小端序：
+//  文件头
+//    char    magic[4]      "MOTA"
+//    quint32 version       TOWER_VERSION
+//    quint32 len, wid, layers
+//    quint32 entityCount   句柄数量（含未定义的占位句柄）
+//    quint64 entityOffset  实体表偏移
+//    quint64 tileOffset    格子平面偏移（8字节对齐）
+//    quint64 contentHash   塔内容哈希（见Data::getContentHash），打包时写入，加载时不必读取全部楼层
+//  实体表，按句柄顺序
+//    quint8  kind          EntityKind
+//    string  id            quint16字节数 + UTF-8
+//    qint32  fields[10]    按种类解释，见entityFields
+//    string  traitID
+//  格子平面，按层依次存放，每层len*wid个Block，行优先
+//    quint16 entity, quint16 floorId
+//====================
+#include "DataManager.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+static const char TOWER_MAGIC[4] = {'M', 'O', 'T', 'A'};
+static const quint32 TOWER_VERSION = 2;
+static const int FIELD_COUNT = 10;
+
+static_assert(sizeof(Block) == 4, "Block必须与塔文件的格子格式一致");
+
+//实体属性与定长整数字段的相互转换
+static void entityFields(const Entity& entity, qint32* fields)
+{
+    std::fill(fields, fields + FIELD_COUNT, 0);
+    switch (entity.kind)
+    {
+    case EntityKind::HeroData:
+    {
+        const HeroState& hero = static_cast<const HeroData&>(entity);
+        const int values[FIELD_COUNT] = {hero.posx, hero.posy, hero.face, hero.hp, hero.atk,
+                                         hero.def, hero.gold, hero.yellow_key, hero.blue_key, hero.red_key};
+        std::copy(values, values + FIELD_COUNT, fields);
+        break;
+    }
+    case EntityKind::Monster:
+    {
+        const Monster& monster = static_cast<const Monster&>(entity);
+        fields[0] = monster.hp;
+        fields[1] = monster.atk;
+        fields[2] = monster.def;
+        fields[3] = monster.gold;
+        break;
+    }
+    case EntityKind::Item:
+    case EntityKind::Door:
+    {
+        const StatDelta& delta = entity.kind == EntityKind::Item
+            ? static_cast<const Item&>(entity).effect
+            : static_cast<const Door&>(entity).cost;
+        const int values[] = {delta.hp, delta.atk, delta.def, delta.gold,
+                              delta.yellow_key, delta.blue_key, delta.red_key};
+        std::copy(std::begin(values), std::end(values), fields);
+        break;
+    }
+    case EntityKind::Stair:
+        fields[0] = static_cast<const Stair&>(entity).floorOffset;
+        break;
+    default:
+        break;
+    }
+}
+
+static void applyFields(Entity& entity, const qint32* fields)
+{
+    switch (entity.kind)
+    {
+    case EntityKind::HeroData:
+    {
+        HeroState& hero = static_cast<HeroData&>(entity);
+        int* values[FIELD_COUNT] = {&hero.posx, &hero.posy, &hero.face, &hero.hp, &hero.atk,
+                                    &hero.def, &hero.gold, &hero.yellow_key, &hero.blue_key, &hero.red_key};
+        for (int i = 0; i < FIELD_COUNT; ++i)
+            *values[i] = fields[i];
+        break;
+    }
+    case EntityKind::Monster:
+    {
+        Monster& monster = static_cast<Monster&>(entity);
+        monster.hp = fields[0];
+        monster.atk = fields[1];
+        monster.def = fields[2];
+        monster.gold = fields[3];
+        break;
+    }
+    case EntityKind::Item:
+    case EntityKind::Door:
+    {
+        StatDelta& delta = entity.kind == EntityKind::Item
+            ? static_cast<Item&>(entity).effect
+            : static_cast<Door&>(entity).cost;
+        delta.hp = fields[0];
+        delta.atk = fields[1];
+        delta.def = fields[2];
+        delta.gold = fields[3];
+        delta.yellow_key = fields[4];
+        delta.blue_key = fields[5];
+        delta.red_key = fields[6];
+        break;
+    }
+    case EntityKind::Stair:
+        static_cast<Stair&>(entity).floorOffset = fields[0];
+        break;
+    default:
+        break;
+    }
+}
+
+//====================
+//写入
+//====================
+
+template <typename T>
+static void appendLE(QByteArray& out, T value)
+{
+    T le = qToLittleEndian(value);
+    out.append(reinterpret_cast<const char*>(&le), sizeof(T));
+}
+
+static void appendString(QByteArray& out, const QString& text)
+{
+    QByteArray utf8 = text.toUtf8();
+    appendLE<quint16>(out, static_cast<quint16>(utf8.size()));
+    out.append(utf8);
+}
+
+QByteArray Data::serializeEntity(EntityHandle handle) const
+{
+    QByteArray out;
+    const std::shared_ptr<Entity>& entityObj = handleTable[handle];
+    qint32 fields[FIELD_COUNT] = {};
+    if (entityObj)
+        entityFields(*entityObj, fields);
+    out.append(static_cast<char>(entityObj ? entityObj->kind : EntityKind::Undefined));
+    appendString(out, handleIds[handle]);
+    for (qint32 field : fields)
+        appendLE<qint32>(out, field);
+    appendString(out, entityObj && entityObj->kind == EntityKind::Monster
+                          ? static_cast<const Monster&>(*entityObj).traitID : QString());
+    return out;
+}
+
+QByteArray Data::serializeTower()
+{
+    //先收集格子平面：未加载的楼层从来源读取到临时楼层，读取时可能登记新的占位句柄
+    QByteArray plane;
+    plane.reserve(qint64(map.len) * map.wid * map.layers * sizeof(Block));
+    Floor scratch(map.len, map.wid);
+    for (int layer = 0; layer < map.layers; ++layer)
+    {
+        const Floor* floor = &map.map[layer];
+        if (!floor->isLoaded())
+        {
+            scratch.allocate();
+            readFloor(layer, scratch);
+            floor = &scratch;
+        }
+        for (const Block& block : floor->tiles)
+        {
+            appendLE<quint16>(plane, block.entity);
+            appendLE<quint16>(plane, block.floorId);
+        }
+    }
+
+    QByteArray out;
+
+    //文件头，偏移量在写完对应部分后回填
+    out.append(TOWER_MAGIC, sizeof(TOWER_MAGIC));
+    appendLE<quint32>(out, TOWER_VERSION);
+    appendLE<quint32>(out, map.len);
+    appendLE<quint32>(out, map.wid);
+    appendLE<quint32>(out, map.layers);
+    appendLE<quint32>(out, handleTable.size());
+    const int offsetPos = out.size();
+    appendLE<quint64>(out, 0);
+    appendLE<quint64>(out, 0);
+    //加载来源的内容哈希原样写入，从塔文件加载时与从文本加载这份塔时得到的相同
+    appendLE<quint64>(out, getContentHash());
+
+    //实体表
+    const quint64 entityOffset = out.size();
+    for (int handle = 0; handle < handleTable.size(); ++handle)
+        out.append(serializeEntity(handle));
+
+    //格子平面，8字节对齐
+    while (out.size() % 8)
+        out.append('\0');
+    const quint64 tileOffset = out.size();
+    out.append(plane);
+
+    qToLittleEndian<quint64>(entityOffset, out.data() + offsetPos);
+    qToLittleEndian<quint64>(tileOffset, out.data() + offsetPos + 8);
+    return out;
+}
+
+void Data::SaveTower(const QString& filePath)
+{
+    //整体写入临时文件后替换，避免留下半个塔文件
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        throw QString("无法写入塔文件:" + filePath);
+    file.write(serializeTower());
+    if (!file.commit())
+        throw QString("无法写入塔文件:" + filePath);
+}
+
+//====================
+//读取
+//====================
+
+//映射内存上的读取游标，越界时抛出异常
+class TowerReader
+{
+public:
+    TowerReader(const uchar* data, qint64 size, const QString& filePath)
+        : data(data), size(size), pos(0), filePath(filePath) {}
+
+    void require(qint64 bytes) const
+    {
+        if (bytes < 0 || pos + bytes > size)
+            throw QString("塔文件已损坏:" + filePath);
+    }
+
+    //文件头中的偏移是无符号数，过大的值转换后为负，这里一并拒绝
+    void seek(quint64 offset)
+    {
+        if (offset > quint64(size))
+            throw QString("塔文件已损坏:" + filePath);
+        pos = qint64(offset);
+    }
+
+    template <typename T>
+    T read()
+    {
+        require(sizeof(T));
+        T value = qFromLittleEndian<T>(data + pos);
+        pos += sizeof(T);
+        return value;
+    }
+
+    quint8 readByte()
+    {
+        require(1);
+        return data[pos++];
+    }
+
+    QString readString()
+    {
+        quint16 length = read<quint16>();
+        require(length);
+        QString text = QString::fromUtf8(reinterpret_cast<const char*>(data + pos), length);
+        pos += length;
+        return text;
+    }
+
+    const uchar* current() const { return data + pos; }
+
+private:
+    const uchar* data;
+    qint64 size;
+    qint64 pos;
+    QString filePath;
+};
+
+void Data::LoadTower(const QString& filePath)
+{
+    std::unique_ptr<QFile> file(new QFile(filePath));
+    if (!file->open(QIODevice::ReadOnly))
+        throw QString("无法打开塔文件:" + filePath);
+    const qint64 size = file->size();
+    const uchar* bytes = file->map(0, size);
+    if (!bytes)
+        throw QString("无法映射塔文件:" + filePath);
+    TowerReader in(bytes, size, filePath);
+
+    //文件头
+    in.require(sizeof(TOWER_MAGIC));
+    if (std::memcmp(in.current(), TOWER_MAGIC, sizeof(TOWER_MAGIC)) != 0)
+        throw QString("不是塔文件:" + filePath);
+    in.seek(sizeof(TOWER_MAGIC));
+    if (in.read<quint32>() != TOWER_VERSION)
+        throw QString("塔文件版本不受支持:" + filePath);
+    const int len = in.read<quint32>();
+    const int wid = in.read<quint32>();
+    const int layers = in.read<quint32>();
+    if (len != map.len || wid != map.wid || layers != map.layers)
+        throw QString("塔文件%1的尺寸与配置不符:%2x%3x%4").arg(filePath).arg(len).arg(wid).arg(layers);
+    const quint32 entityCount = in.read<quint32>();
+    if (entityCount > quint32(std::numeric_limits<EntityHandle>::max()) + 1)
+        throw QString("塔文件已损坏:" + filePath);
+    const quint64 entityOffset = in.read<quint64>();
+    const quint64 tileOffset = in.read<quint64>();
+    contentHash = in.read<quint64>();
+
+    //实体表：重建实体后冻结注册表，再按原顺序登记占位句柄
+    entity.clear();
+    QVector<QString> ids;
+    ids.reserve(entityCount);
+    in.seek(entityOffset);
+    for (int handle = 0; handle < int(entityCount); ++handle)
+    {
+        EntityKind kind = static_cast<EntityKind>(in.readByte());
+        QString id = in.readString();
+        qint32 fields[FIELD_COUNT];
+        for (qint32& field : fields)
+            field = in.read<qint32>();
+        QString traitID = in.readString();
+        ids.append(id);
+
+        //只有占位句柄没有实体对象，其他无法创建的种类说明文件已损坏
+        if (kind == EntityKind::Undefined)
+            continue;
+        std::shared_ptr<Entity> entityObj = createEntity(kind);
+        if (!entityObj)
+            throw QString("塔文件已损坏:" + filePath);
+        entityObj->id = id;
+        applyFields(*entityObj, fields);
+        if (kind == EntityKind::Monster)
+            static_cast<Monster&>(*entityObj).traitID = traitID;
+        entity[id] = entityObj;
+    }
+    freezeRegistry();
+    for (int handle = 0; handle < int(entityCount); ++handle)
+    {
+        if (getHandle(ids[handle]) != handle)
+            throw QString("塔文件%1的实体表与注册表不一致:%2").arg(filePath).arg(ids[handle]);
+    }
+
+    //格子平面保持映射，楼层加载时再拷贝并检查句柄
+    const qint64 floorBytes = qint64(len) * wid * sizeof(Block);
+    in.seek(tileOffset);
+    in.require(floorBytes * layers);
+    towerPlane = in.current();
+    towerFile = std::move(file);
+}
+
+void Data::readFloorBinary(int layer, Floor& floor)
+{
+    //格子平面与Block的内存布局一致，小端机器上整层直接拷贝
+    const qint64 floorBytes = qint64(map.len) * map.wid * sizeof(Block);
+    const uchar* plane = towerPlane + floorBytes * layer;
+    QVector<Block>& tiles = floor.tiles;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    std::memcpy(tiles.data(), plane, floorBytes);
+#else
+    for (int i = 0; i < tiles.size(); ++i)
+    {
+        tiles[i].entity = qFromLittleEndian<quint16>(plane + i * 4);
+        tiles[i].floorId = qFromLittleEndian<quint16>(plane + i * 4 + 2);
+    }
+#endif
+    //句柄必须在实体表范围内，否则之后按句柄查表会越界；只检查加载的这一层，不必扫描整个塔
+    for (const Block& block : std::as_const(tiles))
+    {
+        if (block.entity >= handleTable.size())
+            throw QString("塔文件已损坏:%1 第%2层引用了不存在的实体").arg(towerFile->fileName()).arg(layer);
+    }
+}
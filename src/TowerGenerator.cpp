@@ -0,0 +1,322 @@
+#include "TowerGenerator.h"
+#include <QDir>
+#include <QFile>
+#include <QPoint>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QVector>
+
+//生成时的格子编码，怪物从MONSTER_BASE开始按档位*种类数+种类排列
+enum TileCode : quint16
+{
+    AirCode,
+    WallCode,
+    UpStairCode,
+    DownStairCode,
+    DoorCode,           //黄、蓝、红门
+    KeyCode = DoorCode + 3,     //黄、蓝、红钥匙
+    AtkGemCode = KeyCode + 3,
+    DefGemCode,
+    HpPotion1Code,
+    HpPotion2Code,
+    MONSTER_BASE,
+};
+
+static const char* const TILE_IDS[MONSTER_BASE] = {
+    "air", "wall", "up_stair", "down_stair",
+    "yellow_door", "blue_door", "red_door",
+    "yellow_key", "blue_key", "red_key",
+    "atk_gem", "def_gem", "hp_potion_1", "hp_potion_2",
+};
+static const char* const KEY_NAMES[3] = {"yellow_key", "blue_key", "red_key"};
+
+//怪物种类及第0档属性，第t档的属性为第0档的(2+t)/2倍
+struct MonsterSpecies
+{
+    const char* id;
+    int hp, atk, def, gold;
+};
+static const MonsterSpecies SPECIES[] = {
+    {"green_slime", 20, 8, 1, 1},
+    {"red_slime", 50, 10, 2, 1},
+    {"black_slime", 100, 15, 5, 2},
+    {"skeleton", 110, 25, 5, 5},
+};
+static const int SPECIES_COUNT = sizeof(SPECIES) / sizeof(SPECIES[0]);
+static const int MAX_TIERS = 32;
+
+static void writeText(const QString& filePath, const QByteArray& text)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        throw QString("无法写入文件:" + filePath);
+    if (file.write(text) != text.size())
+        throw QString("无法写入文件:" + filePath);
+}
+
+//门的颜色：黄70%、蓝25%、红5%
+static int randomColor(QRandomGenerator& random)
+{
+    int roll = random.bounded(100);
+    return roll < 70 ? 0 : roll < 95 ? 1 : 2;
+}
+
+//从from到to的随机单调路线（每步都靠近终点），包含两端
+static QVector<QPoint> carvePath(QPoint from, QPoint to, QRandomGenerator& random)
+{
+    QVector<QPoint> path;
+    path.reserve(qAbs(to.x() - from.x()) + qAbs(to.y() - from.y()) + 1);
+    QPoint pos = from;
+    path.append(pos);
+    while (pos != to)
+    {
+        int dx = to.x() - pos.x();
+        int dy = to.y() - pos.y();
+        bool moveX = dy == 0 || (dx != 0 && int(random.bounded(qAbs(dx) + qAbs(dy))) < qAbs(dx));
+        if (moveX)
+            pos.rx() += dx > 0 ? 1 : -1;
+        else
+            pos.ry() += dy > 0 ? 1 : -1;
+        path.append(pos);
+    }
+    return path;
+}
+
+static QPoint randomInterior(const GeneratorOptions& options, QRandomGenerator& random)
+{
+    return QPoint(1 + random.bounded(options.len - 2), 1 + random.bounded(options.wid - 2));
+}
+
+//实体定义文件，各实体之间以空行分隔
+static void writeEntities(const QString& entityDir, const QPoint& heroPos, int tiers)
+{
+    writeText(entityDir + "air.txt", "air AIR\n");
+    writeText(entityDir + "wall.txt", "wall WALL\n");
+    writeText(entityDir + "npc.txt", "");
+    writeText(entityDir + "merchant.txt", "");
+    writeText(entityDir + "stair.txt", "up_stair STAIR\nfloor=1\n\ndown_stair STAIR\nfloor=-1\n");
+    writeText(entityDir + "herodata.txt",
+              QString("hero HERODATA\nposx=%1\nposy=%2\nface=3\nhp=1000\natk=10\ndef=10\ngold=0\n"
+                      "yellow_key=0\nblue_key=0\nred_key=0\n").arg(heroPos.x()).arg(heroPos.y()).toUtf8());
+
+    QByteArray doors;
+    QByteArray items;
+    for (int color = 0; color < 3; ++color)
+    {
+        doors += QString("%1 DOOR\n%2=1\n\n").arg(TILE_IDS[DoorCode + color], KEY_NAMES[color]).toUtf8();
+        items += QString("%1 ITEM\n%1=1\n\n").arg(KEY_NAMES[color]).toUtf8();
+    }
+    items += "atk_gem ITEM\natk=2\n\ndef_gem ITEM\ndef=2\n\nhp_potion_1 ITEM\nhp=200\n\nhp_potion_2 ITEM\nhp=500\n";
+    writeText(entityDir + "door.txt", doors);
+    writeText(entityDir + "item.txt", items);
+
+    QByteArray monsters;
+    for (int tier = 0; tier < tiers; ++tier)
+    {
+        for (const MonsterSpecies& species : SPECIES)
+        {
+            monsters += QString("%1_%2 MONSTER\nhp=%3\natk=%4\ndef=%5\ngold=%6\ntraitID=none\n\n")
+                            .arg(species.id).arg(tier)
+                            .arg(species.hp * (2 + tier) / 2).arg(species.atk * (2 + tier) / 2)
+                            .arg(species.def * (2 + tier) / 2).arg(species.gold * (2 + tier) / 2)
+                            .toUtf8();
+        }
+    }
+    writeText(entityDir + "monster.txt", monsters);
+}
+
+static void writeSprites(const QString& filePath)
+{
+    writeText(filePath,
+              "#由mota_gen生成，怪物ID带档位后缀，按最长前缀匹配精灵\n"
+              "up_stair terrains 6 0\ndown_stair terrains 5 0\n"
+              "wall animates 10 0\nyellow_door animates 4 0\nblue_door animates 5 0\nred_door animates 6 0\n"
+              "yellow_key items 0 0\nblue_key items 1 0\nred_key items 2 0\n"
+              "atk_gem items 16 0\ndef_gem items 17 0\nhp_potion_1 items 20 0\nhp_potion_2 items 21 0\n"
+              "green_slime enemys 0 0 2\nred_slime enemys 1 0 2\nblack_slime enemys 2 0 2\nskeleton enemys 9 0 2\n");
+}
+
+//只改写config.txt中的地图尺寸，保留其他配置项与注释
+static void updateConfig(const QString& filePath, const GeneratorOptions& options)
+{
+    QStringList lines;
+    QFile file(filePath);
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        lines = QString::fromUtf8(file.readAll()).split("\n");
+        file.close();
+    }
+    const QPair<QString, int> sizes[] = {
+        {"mapLen", options.len}, {"mapWid", options.wid}, {"mapLayers", options.layers}};
+    for (const auto& size : sizes)
+    {
+        QString line = QString("%1=%2").arg(size.first).arg(size.second);
+        bool found = false;
+        for (QString& existing : lines)
+        {
+            if (existing.startsWith(size.first + "="))
+            {
+                existing = line;
+                found = true;
+            }
+        }
+        if (!found)
+            lines.append(line);
+    }
+    writeText(filePath, lines.join("\n").toUtf8());
+}
+
+void generateTower(const GeneratorOptions& options, const QString& rootDir)
+{
+    if (options.len < 4 || options.wid < 4 || options.layers < 1)
+        throw QString("塔的尺寸至少为4x4x1");
+    if (options.len > 65535 || options.wid > 65535)
+        throw QString("塔的边长不能超过65535");
+
+    QDir dir(rootDir);
+    if (!dir.mkpath("gamedata/map") || !dir.mkpath("gamedata/entity"))
+        throw QString("无法创建目录:" + dir.filePath("gamedata"));
+
+    QRandomGenerator random(options.seed);
+    const int len = options.len;
+    const int wid = options.wid;
+    const int tiers = qMin(options.layers, MAX_TIERS);
+    const double wallEnd = options.wallDensity;
+    const double monsterEnd = wallEnd + options.monsterDensity;
+    const double itemEnd = monsterEnd + options.itemDensity;
+    const double doorEnd = itemEnd + options.doorDensity;
+
+    //格子编码到ID，行末的空格/换行在写入时追加
+    QVector<QByteArray> ids;
+    for (const char* id : TILE_IDS)
+        ids.append(id);
+    for (int tier = 0; tier < tiers; ++tier)
+    {
+        for (const MonsterSpecies& species : SPECIES)
+            ids.append(QByteArray(species.id) + "_" + QByteArray::number(tier));
+    }
+
+    //floor部分每层都相同
+    QByteArray floorRow;
+    for (int y = 0; y < wid; ++y)
+        floorRow += y + 1 < wid ? "0 " : "0\n";
+
+    QVector<quint16> grid(len * wid);
+    QVector<bool> onPath(len * wid);
+    QPoint arrival = randomInterior(options, random);
+    const QPoint heroPos = arrival;
+
+    for (int layer = 0; layer < options.layers; ++layer)
+    {
+        //主路线：从到达位置到上楼梯
+        QPoint upStair;
+        do
+            upStair = randomInterior(options, random);
+        while (upStair == arrival);
+        QVector<QPoint> path = carvePath(arrival, upStair, random);
+        onPath.fill(false);
+        for (const QPoint& pos : path)
+            onPath[pos.y() * len + pos.x()] = true;
+
+        //其他格子随机填充
+        const int tier = layer * tiers / options.layers;
+        int offPathDoors[3] = {};
+        for (int y = 0; y < wid; ++y)
+        {
+            for (int x = 0; x < len; ++x)
+            {
+                quint16& tile = grid[y * len + x];
+                if (x == 0 || y == 0 || x == len - 1 || y == wid - 1)
+                {
+                    tile = WallCode;
+                    continue;
+                }
+                tile = AirCode;
+                if (onPath[y * len + x])
+                    continue;
+                double roll = random.generateDouble();
+                if (roll < wallEnd)
+                    tile = WallCode;
+                else if (roll < monsterEnd)
+                    tile = MONSTER_BASE + tier * SPECIES_COUNT + random.bounded(SPECIES_COUNT);
+                else if (roll < itemEnd)
+                    tile = AtkGemCode + random.bounded(4);
+                else if (roll < doorEnd)
+                {
+                    int color = randomColor(random);
+                    tile = DoorCode + color;
+                    ++offPathDoors[color];
+                }
+            }
+        }
+
+        //主路线以外的钥匙：随机放在路线以外的空地上
+        for (int color = 0; color < 3; ++color)
+        {
+            int keys = qRound(offPathDoors[color] * options.keyRatio);
+            for (int attempt = 0; keys > 0 && attempt < keys * 16 + 64; ++attempt)
+            {
+                QPoint pos = randomInterior(options, random);
+                quint16& tile = grid[pos.y() * len + pos.x()];
+                if (tile == AirCode && !onPath[pos.y() * len + pos.x()])
+                {
+                    tile = KeyCode + color;
+                    --keys;
+                }
+            }
+        }
+
+        //主路线上的门，对应钥匙放在路线上更早的空格子
+        for (int i = 2; i + 1 < path.size(); ++i)
+        {
+            if (random.generateDouble() >= options.doorDensity)
+                continue;
+            const QPoint& doorPos = path[i];
+            if (grid[doorPos.y() * len + doorPos.x()] != AirCode)
+                continue;
+            for (int attempt = 0; attempt < 8; ++attempt)
+            {
+                const QPoint& keyPos = path[1 + random.bounded(i - 1)];
+                quint16& keyTile = grid[keyPos.y() * len + keyPos.x()];
+                if (keyTile == AirCode)
+                {
+                    int color = randomColor(random);
+                    keyTile = KeyCode + color;
+                    grid[doorPos.y() * len + doorPos.x()] = DoorCode + color;
+                    break;
+                }
+            }
+        }
+
+        //楼梯：底层的到达位置是勇者，其余为下楼梯；上一层的下楼梯即本层主路线的下一段起点
+        if (layer > 0)
+            grid[arrival.y() * len + arrival.x()] = DownStairCode;
+        grid[upStair.y() * len + upStair.x()] = UpStairCode;
+
+        //地图文件的第x行第y列为格子(x,y)
+        QByteArray text;
+        text.reserve(len * wid * 10 + len * floorRow.size() + 16);
+        text += "entity\n";
+        for (int x = 0; x < len; ++x)
+        {
+            for (int y = 0; y < wid; ++y)
+            {
+                text += ids[grid[y * len + x]];
+                text += y + 1 < wid ? ' ' : '\n';
+            }
+        }
+        text += "floor\n";
+        for (int x = 0; x < len; ++x)
+            text += floorRow;
+        writeText(dir.filePath(QString("gamedata/map/map%1.txt").arg(layer)), text);
+
+        //下一层的下楼梯位置，勇者上楼后站在那里
+        arrival = randomInterior(options, random);
+    }
+
+    writeEntities(dir.filePath("gamedata/entity/"), heroPos, tiers);
+    writeSprites(dir.filePath("gamedata/sprites.txt"));
+    updateConfig(dir.filePath("config.txt"), options);
+    //旧的二进制塔文件会优先于新生成的文本地图加载
+    QFile::remove(dir.filePath("gamedata/tower.bin"));
+}
@@ -0,0 +1,27 @@
+//====================
+//随机塔生成器
+//====================
+#pragma once
+#include <QString>
+
+//生成参数，密度均为内部（非边界、非主路线）格子中的比例
+struct GeneratorOptions
+{
+    int len = 12;               //每层列数
+    int wid = 12;               //每层行数
+    int layers = 6;
+    quint32 seed = 1;
+    double wallDensity = 0.3;
+    double monsterDensity = 0.08;
+    double itemDensity = 0.04;
+    double doorDensity = 0.02;  //主路线与其他格子中门的比例
+    double keyRatio = 1.0;      //主路线以外的钥匙数与门数之比，主路线上的门总有对应钥匙
+};
+
+//在rootDir下写入gamedata/map/map*.txt、gamedata/entity/*.txt与gamedata/sprites.txt，
+//并更新config.txt中的地图尺寸（其他配置项保留），删除已过期的gamedata/tower.bin。
+//每层从到达位置（底层为勇者位置，其余为下楼梯）到上楼梯有一条只含空地、门和钥匙的主路线，
+//路线上每扇门的钥匙都放在路线上更早的位置，因此沿主路线总能走到顶层的上楼梯。
+//怪物按楼层分为若干档，ID带档位后缀（如green_slime_3），按前缀使用对应精灵。
+//写入失败时抛出QString
+void generateTower(const GeneratorOptions& options, const QString& rootDir);
@@ -0,0 +1,60 @@
+//====================
+//Zobrist状态哈希
+//====================
+#pragma once
+#include <QtGlobal>
+#include "Entity.h"
+
+//64位整数混合（splitmix64的末段）
+inline quint64 mix64(quint64 x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+//格子(layer,x,y)上放置实体handle的键值；整张地图的哈希为所有格子键值的异或，
+//修改一个格子只需异或掉旧键值、再异或上新键值
+inline quint64 zobristTile(int layer, int x, int y, EntityHandle handle)
+{
+    quint64 pos = (quint64(quint32(layer)) << 40) | (quint64(quint32(y)) << 20) | quint32(x);
+    return mix64(mix64(pos + 0x9e3779b97f4a7c15ULL) ^ handle);
+}
+
+//勇者状态的键值（位置、朝向与全部属性）
+inline quint64 zobristHero(const HeroState& hero)
+{
+    const int fields[] = {hero.posx, hero.posy, hero.face, hero.hp, hero.atk, hero.def,
+                          hero.gold, hero.yellow_key, hero.blue_key, hero.red_key};
+    quint64 h = 0x6a09e667f3bcc908ULL;
+    for (int value : fields)
+        h = mix64(h ^ quint32(value));
+    return h;
+}
+
+//当前楼层的键值
+inline quint64 zobristFloor(int floor)
+{
+    return mix64(0xbb67ae8584caa73bULL ^ quint32(floor));
+}
+
+//任意字节串的64位哈希（按8字节分组混合），用于塔内容等整体校验
+inline quint64 hashBytes(const char* data, qint64 size)
+{
+    quint64 h = 0x3c6ef372fe94f82bULL ^ quint64(size);
+    qint64 i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        quint64 chunk = 0;
+        for (int b = 0; b < 8; ++b)
+            chunk |= quint64(quint8(data[i + b])) << (8 * b);
+        h = mix64(h ^ chunk) + 0x9e3779b97f4a7c15ULL;
+    }
+    quint64 tail = 0;
+    for (int b = 0; i < size; ++i, ++b)
+        tail |= quint64(quint8(data[i])) << (8 * b);
+    return mix64(h ^ tail);
+}
@@ -0,0 +1,356 @@
+#include "Config.h"
+#include "DataManager.h"
+#include "game.h"
+#include "Combat.h"
+#include "GameWidget.h"
+#include "TowerGenerator.h"
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+//====================
+//微基准测试：mota_bench [--sizes 12,64,128] [--layers 3] [--rounds 10] [--json 文件]
+//测试用的塔由TowerGenerator按固定种子生成在临时目录中
+//每个基准先倍增迭代次数直到一轮不少于--min-time毫秒，再重复--rounds轮，
+//报告每次操作耗时（纳秒）的最小值、中位数、平均值与标准差
+//====================
+
+//基准的一轮：执行iterations次被测操作
+using BenchBody = std::function<void(qint64 iterations)>;
+
+struct BenchResult
+{
+    QString name;
+    int size = 0;
+    int layers = 0;
+    qint64 iterations = 0;
+    QVector<double> samples;    //每轮的纳秒/次
+    double minNs = 0;
+    double medianNs = 0;
+    double meanNs = 0;
+    double stddevNs = 0;
+};
+
+struct BenchOptions
+{
+    int rounds = 10;
+    qint64 minTimeNs = 20000000;
+    QString filter;
+};
+
+//防止被测结果被优化掉
+static volatile quint64 benchSink = 0;
+
+static BenchResult runBench(const BenchOptions& options, const QString& name, int size, int layers, const BenchBody& body)
+{
+    BenchResult result;
+    result.name = name;
+    result.size = size;
+    result.layers = layers;
+
+    //预热并校准迭代次数
+    QElapsedTimer timer;
+    qint64 iterations = 1;
+    for (;;)
+    {
+        timer.start();
+        body(iterations);
+        qint64 elapsed = timer.nsecsElapsed();
+        if (elapsed >= options.minTimeNs || iterations >= (qint64(1) << 40))
+            break;
+        iterations *= elapsed > 0 ? qBound<qint64>(2, options.minTimeNs / elapsed + 1, 16) : 16;
+    }
+    result.iterations = iterations;
+
+    for (int round = 0; round < options.rounds; ++round)
+    {
+        timer.start();
+        body(iterations);
+        result.samples.append(double(timer.nsecsElapsed()) / iterations);
+    }
+
+    QVector<double> sorted = result.samples;
+    std::sort(sorted.begin(), sorted.end());
+    const int n = sorted.size();
+    result.minNs = sorted.first();
+    result.medianNs = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    double sum = 0;
+    for (double sample : sorted)
+        sum += sample;
+    result.meanNs = sum / n;
+    double variance = 0;
+    for (double sample : sorted)
+        variance += (sample - result.meanNs) * (sample - result.meanNs);
+    result.stddevNs = n > 1 ? std::sqrt(variance / (n - 1)) : 0;
+    return result;
+}
+
+//====================
+//基准
+//====================
+
+//第一个种类为kind的句柄（楼梯取上楼梯），没有时返回AIR_HANDLE
+static EntityHandle firstOfKind(const Data& data, EntityKind kind)
+{
+    for (int handle = 0; handle < data.handleCount(); ++handle)
+    {
+        if (data.getKind(handle) == kind && (kind != EntityKind::Stair || data.getStairOffset(handle) > 0))
+            return handle;
+    }
+    return AIR_HANDLE;
+}
+
+//单步移动：勇者在(1,1)向右走向(2,1)上的实体，每次操作后恢复格子、勇者与楼层
+//勇者属性足以无伤击败任何怪物并打开任何门
+static BenchBody moveBody(Game& game, EntityKind kind)
+{
+    Data* data = game.getGameData();
+    EntityHandle target = firstOfKind(*data, kind);
+    EntityHandle air = firstOfKind(*data, EntityKind::Air);
+    std::shared_ptr<HeroData> hero = data->getHeroData();
+    HeroState start = *hero;
+    start.posx = 1;
+    start.posy = 1;
+    start.hp = start.atk = start.def = 1000000;
+    start.yellow_key = start.blue_key = start.red_key = 1;
+    return [&game, data, hero, start, target, air](qint64 iterations) {
+        data->setEntity(air, 1, 1, 0);
+        for (qint64 i = 0; i < iterations; ++i)
+        {
+            data->setEntity(target, 2, 1, 0);
+            static_cast<HeroState&>(*hero) = start;
+            if (game.getCurrentFloor() != 0)
+                game.setCurrentFloor(0);
+            benchSink += game.handleInput(InputAction::MoveRight);
+        }
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    //没有显示服务器时也能离屏绘制
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("魔塔微基准：加载、移动、战斗、位置查询与离屏绘制");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption("sizes", "合成塔每层的边长，逗号分隔", "list", "12,64,128");
+    QCommandLineOption layersOption("layers", "合成塔层数（至少2）", "n", "3");
+    QCommandLineOption seedOption("seed", "合成塔的随机种子", "n", "1");
+    QCommandLineOption roundsOption("rounds", "每个基准重复的轮数", "n", "10");
+    QCommandLineOption minTimeOption("min-time", "每轮最少耗时（毫秒）", "ms", "20");
+    QCommandLineOption blockOption("block", "绘制基准的格子大小（像素）", "px", "32");
+    QCommandLineOption renderMaxOption("render-max", "只对边长不超过该值的塔做绘制基准", "n", "128");
+    QCommandLineOption filterOption("filter", "只运行名称包含该字符串的基准", "text");
+    QCommandLineOption jsonOption("json", "把结果以JSON写入文件，-为标准输出", "file");
+    parser.addOption(sizesOption);
+    parser.addOption(layersOption);
+    parser.addOption(seedOption);
+    parser.addOption(roundsOption);
+    parser.addOption(minTimeOption);
+    parser.addOption(blockOption);
+    parser.addOption(renderMaxOption);
+    parser.addOption(filterOption);
+    parser.addOption(jsonOption);
+    parser.process(app);
+
+    BenchOptions options;
+    options.rounds = qMax(1, parser.value(roundsOption).toInt());
+    options.minTimeNs = qMax(1, parser.value(minTimeOption).toInt()) * qint64(1000000);
+    options.filter = parser.value(filterOption);
+    const int layers = qMax(2, parser.value(layersOption).toInt());
+    const int blockSize = qMax(1, parser.value(blockOption).toInt());
+    const int renderMax = parser.value(renderMaxOption).toInt();
+    QVector<int> sizes;
+    for (const QString& size : parser.value(sizesOption).split(",", Qt::SkipEmptyParts))
+        sizes.append(qMax(4, size.toInt()));
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    const bool jsonToStdout = parser.value(jsonOption) == "-";
+    QTextStream& table = jsonToStdout ? err : out;
+
+    QVector<BenchResult> results;
+    auto bench = [&](const QString& name, int size, const BenchBody& body) {
+        if (!options.filter.isEmpty() && !name.contains(options.filter))
+            return;
+        BenchResult result = runBench(options, name, size, layers, body);
+        table << QString("%1 %2  %3 ns/op  (min %4, mean %5, stddev %6, %7 次 x %8 轮)")
+                     .arg(name, -18).arg(QString("%1x%1").arg(size), -9)
+                     .arg(result.medianNs, 12, 'f', 1).arg(result.minNs, 0, 'f', 1)
+                     .arg(result.meanNs, 0, 'f', 1).arg(result.stddevNs, 0, 'f', 1)
+                     .arg(result.iterations).arg(result.samples.size())
+              << Qt::endl;
+        results.append(result);
+    };
+
+    try {
+        for (int size : sizes) {
+            QTemporaryDir towerDir;
+            if (!towerDir.isValid())
+                throw QString("无法创建临时目录");
+            const QString root = towerDir.path();
+            GeneratorOptions tower;
+            tower.len = tower.wid = size;
+            tower.layers = layers;
+            tower.seed = parser.value(seedOption).toUInt();
+            generateTower(tower, root);
+
+            //加载：全部实体文件（0层地图）、启动（实体与预加载楼层）、文本全塔与二进制全塔
+            auto loadAll = [](Data& data) {
+                for (int layer = 0; layer < data.map.layers; ++layer)
+                    benchSink += data.map.getFloor(layer).tiles.size();
+            };
+            bench("load/entity", size, [&](qint64 iterations) {
+                for (qint64 i = 0; i < iterations; ++i) {
+                    Data data(size, size, 0, root, false);
+                    benchSink += data.handleCount();
+                }
+            });
+            bench("load/startup", size, [&](qint64 iterations) {
+                for (qint64 i = 0; i < iterations; ++i) {
+                    Data data(size, size, layers, root, false);
+                    benchSink += data.residentFloorCount();
+                }
+            });
+            bench("load/text", size, [&](qint64 iterations) {
+                for (qint64 i = 0; i < iterations; ++i) {
+                    Data data(size, size, layers, root, false);
+                    loadAll(data);
+                }
+            });
+            {
+                Data data(size, size, layers, root, false);
+                data.SaveTower(data.getTowerPath());
+            }
+            bench("load/binary", size, [&](qint64 iterations) {
+                for (qint64 i = 0; i < iterations; ++i) {
+                    Data data(size, size, layers, root, true);
+                    loadAll(data);
+                }
+            });
+            QFile::remove(QDir(root).filePath("gamedata/tower.bin"));
+
+            //逻辑：按目标实体种类的单步移动，其中monster即一次完整战斗
+            Data data(size, size, layers, root, false);
+            Game game(&data);
+            game.setUndoDepth(0);
+            const QPair<const char*, EntityKind> moveTargets[] = {
+                {"move/air", EntityKind::Air}, {"move/wall", EntityKind::Wall}, {"move/door", EntityKind::Door},
+                {"move/item", EntityKind::Item}, {"move/monster", EntityKind::Monster}, {"move/stair", EntityKind::Stair},
+            };
+            for (const auto& target : moveTargets)
+                bench(target.first, size, moveBody(game, target.second));
+            data.setEntity(firstOfKind(data, EntityKind::Air), 2, 1, 0);
+
+            EntityHandle monsterHandle = firstOfKind(data, EntityKind::Monster);
+            const Monster& monster = static_cast<const Monster&>(*data.getEntity(monsterHandle));
+            bench("combat/forecast", size, [&](qint64 iterations) {
+                for (qint64 i = 0; i < iterations; ++i)
+                    benchSink += forecastBattle(int(i & 63) + 3, int(i & 7), monster).damage;
+            });
+
+            //位置查询
+            bench("query/findFirst", size, [&](qint64 iterations) {
+                for (qint64 i = 0; i < iterations; ++i)
+                    benchSink += data.findFirst(monsterHandle, int(i % layers)).x();
+            });
+            bench("query/findAll", size, [&](qint64 iterations) {
+                for (qint64 i = 0; i < iterations; ++i)
+                    benchSink += data.findAll(EntityKind::Monster, int(i % layers)).size();
+            });
+            bench("query/findStair", size, [&](qint64 iterations) {
+                for (qint64 i = 0; i < iterations; ++i)
+                    benchSink += data.findStair(int(i % layers), 1).y();
+            });
+
+            //绘制：整个GameWidget离屏绘制到QImage，静止帧与每帧走一步
+            if (size <= renderMax) {
+                Config config;
+                config.readConfig(root);
+                config["blockSize"] = QString::number(blockSize);
+                Data renderData(size, size, layers, root, false);
+                GameWidget widget(&renderData, &config);
+                QImage image(widget.size(), QImage::Format_ARGB32_Premultiplied);
+                widget.render(&image);
+                bench("render/frame", size, [&](qint64 iterations) {
+                    for (qint64 i = 0; i < iterations; ++i)
+                        widget.render(&image);
+                });
+                //勇者在(1,1)与(2,1)之间来回走
+                renderData.setEntity(firstOfKind(renderData, EntityKind::Air), 1, 1, 0);
+                renderData.setEntity(firstOfKind(renderData, EntityKind::Air), 2, 1, 0);
+                renderData.getHeroData()->posx = 1;
+                renderData.getHeroData()->posy = 1;
+                Game* renderGame = widget.getGame();
+                bench("render/move", size, [&](qint64 iterations) {
+                    for (qint64 i = 0; i < iterations; ++i) {
+                        renderGame->handleInput(i % 2 ? InputAction::MoveLeft : InputAction::MoveRight);
+                        widget.render(&image);
+                    }
+                });
+            }
+        }
+    }
+    catch (const QString& e) {
+        err << e << Qt::endl;
+        return 2;
+    }
+    catch (const std::exception& e) {
+        err << QString::fromStdString(e.what()) << Qt::endl;
+        return 2;
+    }
+
+    if (parser.isSet(jsonOption)) {
+        QJsonArray entries;
+        for (const BenchResult& result : std::as_const(results)) {
+            QJsonArray samples;
+            for (double sample : result.samples)
+                samples.append(sample);
+            entries.append(QJsonObject{
+                {"name", result.name},
+                {"size", result.size},
+                {"layers", result.layers},
+                {"iterations", result.iterations},
+                {"minNs", result.minNs},
+                {"medianNs", result.medianNs},
+                {"meanNs", result.meanNs},
+                {"stddevNs", result.stddevNs},
+                {"samplesNs", samples},
+            });
+        }
+        QJsonObject root{
+            {"qtVersion", QString(qVersion())},
+            {"rounds", options.rounds},
+            {"minTimeMs", int(options.minTimeNs / 1000000)},
+            {"results", entries},
+        };
+        QByteArray json = QJsonDocument(root).toJson();
+        if (jsonToStdout) {
+            out << json;
+            out.flush();
+        } else {
+            QFile file(parser.value(jsonOption));
+            if (!file.open(QIODevice::WriteOnly)) {
+                err << "无法写入结果文件:" << file.fileName() << Qt::endl;
+                return 2;
+            }
+            file.write(json);
+        }
+    }
+    return 0;
+}
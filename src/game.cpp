@@ -1,12 +1,16 @@
 #include "game.h"
+#include "Zobrist.h"
 #include <QDebug>
 #include <cmath>
+#include <algorithm>
 
 Game::Game(Data* data, QObject *parent)
     : QObject(parent)
     , gameData(data)
     , currentFloor(0)
+    , quickSaves(QUICK_SAVE_SLOTS)
 {
+    setUndoDepth(1000);
 }
 
 Game::~Game()
@@ -16,12 +20,204 @@ Game::~Game()
 void Game::setCurrentFloor(int floor)
 {
     if (floor >= 0 && floor < gameData->map.layers) {
+        // 进入楼层时加载该层，并按内存上限换出不再需要的楼层
+        gameData->enterFloor(floor);
+        beginChange();
         currentFloor = floor;
-        emit floorChanged(floor);
+        commitChange();
     }
 }
 
+void Game::beginChange()
+{
+    if (changeDepth++ > 0)
+        return;
+    // 就地清空，保留tiles的容量，稳定后记录变化不再分配内存
+    pendingChange.tiles.resize(0);
+    pendingChange.heroFields = 0;
+    if (auto hero = gameData->getHeroData())
+        pendingChange.heroBefore = pendingChange.heroAfter = *hero;
+    pendingChange.floorBefore = pendingChange.floorAfter = currentFloor;
+}
+
+void Game::commitChange()
+{
+    if (--changeDepth > 0)
+        return;
+    if (auto hero = gameData->getHeroData())
+        pendingChange.heroAfter = *hero;
+    pendingChange.heroFields = diffHero(pendingChange.heroBefore, pendingChange.heroAfter);
+    pendingChange.floorAfter = currentFloor;
+    
+    // 记录到撤销缓冲（撤销/重做本身不记录），再通知状态变化，最后通知结局，界面在弹出结局对话框前已经刷新
+    if (!pendingChange.isEmpty()) {
+        if (!replayingUndo && !undoRing.isEmpty()) {
+            // 复用槽位中已分配的容量，稳定后记录不再分配内存
+            ChangeSet& record = undoRing[undoHead];
+            // 逐项拷贝到槽位自己的缓冲中；整体赋值会与pendingChange共享数据，下次清空时被迫分离
+            record.tiles.resize(pendingChange.tiles.size());
+            std::copy(pendingChange.tiles.cbegin(), pendingChange.tiles.cend(), record.tiles.begin());
+            record.heroBefore = pendingChange.heroBefore;
+            record.heroAfter = pendingChange.heroAfter;
+            record.heroFields = pendingChange.heroFields;
+            record.floorBefore = pendingChange.floorBefore;
+            record.floorAfter = pendingChange.floorAfter;
+            undoActions[undoHead] = pendingAction;
+            undoHead = (undoHead + 1) % undoRing.size();
+            undoCount = qMin(undoCount + 1, undoRing.size());
+            redoCount = 0;
+        }
+        if (!replayingUndo && pendingAction != InputAction::None)
+            recordInput(pendingAction);
+        emit stateChanged(pendingChange);
+        // 槽中保留了pendingChange的拷贝时tiles会被共享，下次清空记录时被迫分离
+        Q_ASSERT(pendingChange.tiles.capacity() == 0 || pendingChange.tiles.isDetached());
+    }
+    if (pendingGameOver) {
+        pendingGameOver = false;
+        emit gameOver();
+    }
+    if (pendingSuccess) {
+        pendingSuccess = false;
+        emit gameSuccess();
+    }
+}
+
+void Game::setTile(int layer, int x, int y, EntityHandle handle)
+{
+    Block& block = gameData->map.getFloor(layer).getBlock(x, y);
+    if (block.entity == handle)
+        return;
+    TileChange tile = {layer, x, y, block.entity, handle};
+    gameData->setEntity(handle, x, y, layer);
+    pendingChange.tiles.append(tile);
+}
+
+void Game::setUndoDepth(int depth)
+{
+    // 预先分配全部槽位，每个槽位预留少量格子容量
+    undoRing = QVector<ChangeSet>(qMax(0, depth));
+    undoActions = QVector<InputAction>(undoRing.size(), InputAction::None);
+    for (ChangeSet& record : undoRing)
+        record.tiles.reserve(4);
+    undoHead = 0;
+    undoCount = 0;
+    redoCount = 0;
+}
+
+void Game::applyRecord(const ChangeSet& record, bool reverse)
+{
+    auto hero = gameData->getHeroData();
+    replayingUndo = true;
+    beginChange();
+    if (reverse) {
+        for (int i = record.tiles.size() - 1; i >= 0; --i) {
+            const TileChange& tile = record.tiles[i];
+            setTile(tile.layer, tile.x, tile.y, tile.before);
+        }
+    } else {
+        for (const TileChange& tile : record.tiles)
+            setTile(tile.layer, tile.x, tile.y, tile.after);
+    }
+    if (hero)
+        static_cast<HeroState&>(*hero) = reverse ? record.heroBefore : record.heroAfter;
+    currentFloor = reverse ? record.floorBefore : record.floorAfter;
+    gameData->enterFloor(currentFloor);
+    commitChange();
+    replayingUndo = false;
+}
+
+bool Game::undo()
+{
+    if (undoCount == 0)
+        return false;
+    undoHead = (undoHead + undoRing.size() - 1) % undoRing.size();
+    --undoCount;
+    ++redoCount;
+    applyRecord(undoRing[undoHead], true);
+    unrecordInput(undoActions[undoHead]);
+    return true;
+}
+
+bool Game::redo()
+{
+    if (redoCount == 0)
+        return false;
+    int index = undoHead;
+    undoHead = (undoHead + 1) % undoRing.size();
+    ++undoCount;
+    --redoCount;
+    applyRecord(undoRing[index], false);
+    rerecordInput(undoActions[index]);
+    return true;
+}
+
+void Game::unrecordInput(InputAction action)
+{
+    // 撤销的是一次输入时去掉序列末尾的这次输入；撤销快速读档后序列无法还原
+    if (action != InputAction::None && !inputHistory.isEmpty())
+        inputHistory.removeLast();
+    else
+        historyValid = false;
+}
+
+void Game::rerecordInput(InputAction action)
+{
+    if (action != InputAction::None)
+        recordInput(action);
+    else
+        historyValid = false;
+}
+
+void Game::recordInput(InputAction action)
+{
+    if (inputHistory.size() == inputHistory.capacity())
+        inputHistory.reserve(inputHistory.size() + INPUT_HISTORY_CHUNK);
+    inputHistory.append(action);
+}
+
+
+quint64 Game::stateHash() const
+{
+    return gameData->stateHash() ^ zobristFloor(currentFloor);
+}
+
+bool Game::quickSave(int slot)
+{
+    if (slot < 0 || slot >= quickSaves.size())
+        return false;
+    QuickSave& save = quickSaves[slot];
+    save.valid = true;
+    save.delta = gameData->captureDelta();
+    save.floor = currentFloor;
+    save.history = inputHistory;
+    save.historyValid = historyValid;
+    emit messageLogged(QString("已快速存档到%1号槽（%2个格子变化）").arg(slot).arg(gameData->deltaSize()));
+    return true;
+}
 
+bool Game::quickLoad(int slot)
+{
+    if (!hasQuickSave(slot))
+        return false;
+    const QuickSave& save = quickSaves[slot];
+    
+    // 在初始塔上重放存档的变化，变化的格子全部记入本次ChangeSet
+    beginChange();
+    gameData->restoreDelta(save.delta, &pendingChange.tiles);
+    currentFloor = save.floor;
+    gameData->enterFloor(currentFloor);
+    inputHistory = save.history;
+    historyValid = save.historyValid;
+    commitChange();
+    emit messageLogged(QString("已读取%1号槽的快速存档").arg(slot));
+    return true;
+}
+
+bool Game::hasQuickSave(int slot) const
+{
+    return slot >= 0 && slot < quickSaves.size() && quickSaves[slot].valid;
+}
 
 bool Game::handleInput(InputAction action)
 {
@@ -53,15 +249,17 @@ bool Game::handleInput(InputAction action)
             return false;
     }
     
+    beginChange();
+    pendingAction = action;
+    
     // 更新朝向
-    if (hero->face != newFace)
-    {
-        hero->face = newFace;
-        emit heroStatusChanged();
-    }
+    hero->face = newFace;
     
     // 处理移动
-    return processMove(dx, dy);
+    bool moved = processMove(dx, dy);
+    commitChange();
+    pendingAction = InputAction::None;
+    return moved;
 }
 
 bool Game::processMove(int dx, int dy)
@@ -79,133 +277,85 @@ bool Game::processMove(int dx, int dy)
         return false;
     }
     
-    // 取得目标位置的实体
-    Floor& floor = gameData->map.getFloor(currentFloor);
-    Block& targetBlock = floor.getBlock(newX, newY);
-    QString entityId = targetBlock.entityId;
-    auto entity = gameData->getEntity(entityId);
-    
-    // 根据实体类型处理交互
-    if (entityId == "air" || entityId.isEmpty()) {
-        // 仅当交互对象是AIR时才移动勇者
-        hero->posx = newX;
-        hero->posy = newY;
-        emit heroStatusChanged();
-        return true;
-    } else if (entity && entity->type == "WALL") {
-        // 遇到WALL时保持位置不动
-        return false;
-    } else if (entity && entity->type == "DOOR") {
-        // 与DOOR交互
-        return handleDoorInteraction(newX, newY, entityId);
-    } else if (entity && entity->type == "ITEM") {
-        // 与ITEM交互
-        return handleItemInteraction(newX, newY, entityId);
-    } else if (entity && entity->type == "MONSTER") {
-        // 与MONSTER交互
-        return handleMonsterInteraction(newX, newY, entityId);
-    } else if (entity && entity->type == "STAIR") {
-        // 与STAIR交互
-        return handleStairInteraction(newX, newY, entityId);
-    } else if (entity && (entity->type == "NPC" || entity->type == "MERCHANT")) {
-        // NPC和MERCHANT的交互留空
-        return false;
-    }
+    // 取得目标位置的实体句柄，按实体种类查表分派交互
+    EntityHandle handle = gameData->map.getFloor(currentFloor).getBlock(newX, newY).entity;
+    Interaction interaction = interactionTable[static_cast<int>(gameData->getKind(handle))];
+    return (this->*interaction)(newX, newY, handle);
+}
+
+const Game::Interaction Game::interactionTable[static_cast<int>(EntityKind::Count)] = {
+    &Game::handleAirInteraction,        // AIR
+    &Game::handleBlockedInteraction,    // HERODATA
+    &Game::handleBlockedInteraction,    // WALL
+    &Game::handleDoorInteraction,       // DOOR
+    &Game::handleItemInteraction,       // ITEM
+    &Game::handleMonsterInteraction,    // MONSTER
+    &Game::handleBlockedInteraction,    // NPC，交互留空
+    &Game::handleBlockedInteraction,    // MERCHANT，交互留空
+    &Game::handleStairInteraction,      // STAIR
+    &Game::handleBlockedInteraction,    // 未定义实体
+};
+
+bool Game::handleAirInteraction(int x, int y, EntityHandle handle)
+{
+    Q_UNUSED(handle);
+    auto hero = gameData->getHeroData();
     
+    // 仅当交互对象是AIR时才移动勇者
+    hero->posx = x;
+    hero->posy = y;
+    return true;
+}
+
+bool Game::handleBlockedInteraction(int x, int y, EntityHandle handle)
+{
+    // 遇到WALL等不可交互的实体时保持位置不动
+    Q_UNUSED(x);
+    Q_UNUSED(y);
+    Q_UNUSED(handle);
     return false;
 }
 
-bool Game::handleDoorInteraction(int x, int y, const QString& entityId)
+bool Game::handleDoorInteraction(int x, int y, EntityHandle handle)
 {
     auto hero = gameData->getHeroData();
-    if (!hero) return false;
     
-    Floor& floor = gameData->map.getFloor(currentFloor);
-    Block& block = floor.getBlock(x, y);
+    // 门的开门消耗在door.txt中声明，加载时编译进效果表
+    const StatDelta& cost = gameData->getEffect(handle);
+    if (!hero->canPay(cost))
+        return false; // 钥匙不足，无法开门
     
-    // 根据门的ID类型消耗对应颜色的钥匙
-    if (entityId.contains("yellow") || entityId.contains("door1")) {
-        if (hero->yellow_key > 0) {
-            hero->yellow_key--;
-            block.entityId = "air"; // 成功开门，设置为AIR
-            emit mapUpdated();
-            emit heroStatusChanged();
-            return true;
-        }
-    } else if (entityId.contains("blue")) {
-        if (hero->blue_key > 0) {
-            hero->blue_key--;
-            block.entityId = "air"; // 成功开门，设置为AIR
-            emit mapUpdated();
-            emit heroStatusChanged();
-            return true;
-        }
-    } else if (entityId.contains("red")) {
-        if (hero->red_key > 0) {
-            hero->red_key--;
-            block.entityId = "air"; // 成功开门，设置为AIR
-            emit mapUpdated();
-            emit heroStatusChanged();
-            return true;
-        }
-    }
-    
-    return false; // 钥匙不足，无法开门
+    hero->apply(cost, -1);
+    clearTile(x, y); // 成功开门，设置为AIR
+    return true;
 }
 
-bool Game::handleItemInteraction(int x, int y, const QString& entityId)
+bool Game::handleItemInteraction(int x, int y, EntityHandle handle)
 {
     auto hero = gameData->getHeroData();
-    if (!hero) return false;
-    
-    Floor& floor = gameData->map.getFloor(currentFloor);
-    Block& block = floor.getBlock(x, y);
     
-    // 使用长if-else链处理每种物品ID
-    if (entityId.contains("yellow_key")) {
-        hero->yellow_key++;
-    } else if (entityId.contains("blue_key")) {
-        hero->blue_key++;
-    } else if (entityId.contains("red_key")) {
-        hero->red_key++;
-    } else if (entityId.contains("hp_potion_1")) {
-        hero->hp += 200;
-    } else if (entityId.contains("hp_potion_2")) {
-        hero->hp += 300;
-    } else if (entityId.contains("hp_potion_3")) {
-        hero->hp += 500;
-    } else if (entityId.contains("atk_gem")) {
-        hero->atk += 3;
-    } else if (entityId.contains("def_gem")) {
-        hero->def += 3;
-    }
+    // 物品效果在item.txt中声明，加载时编译进效果表
+    hero->apply(gameData->getEffect(handle));
     
     // 物品被拾取后设置为AIR
-    block.entityId = "air";
-    emit mapUpdated();
-    emit heroStatusChanged();
+    clearTile(x, y);
     return true;
 }
 
-bool Game::handleMonsterInteraction(int x, int y, const QString& entityId)
+bool Game::handleMonsterInteraction(int x, int y, EntityHandle handle)
 {
     auto hero = gameData->getHeroData();
     if (!hero) return false;
     
-    auto entity = gameData->getEntity(entityId);
-    auto monster = std::dynamic_pointer_cast<Monster>(entity);
+    auto monster = std::dynamic_pointer_cast<Monster>(gameData->getEntity(handle));
     if (!monster) return false;
     
     // 进入战斗函数
-    if (hero->atk <= monster->def) {
+    BattleForecast battle = forecastBattle(hero->atk, hero->def, *monster);
+    if (!battle.canBreak) {
         return false; // 攻击力不足，无法破防
     }
-    
-    int heroDamage = hero->atk - monster->def;
-    int monsterDamage = qMax(0, monster->atk - hero->def);
-    
-    int turns = (monster->hp + heroDamage - 1) / heroDamage;
-    int totalDamage = (turns - 1) * monsterDamage;
+    int totalDamage = battle.damage;
     
     if (hero->hp > totalDamage) {
         //战斗胜利，勇者hp>0
@@ -213,44 +363,32 @@ bool Game::handleMonsterInteraction(int x, int y, const QString& entityId)
         hero->gold += monster->gold;
         
         //设置怪物位置为AIR
-        Floor& floor = gameData->map.getFloor(currentFloor);
-        Block& block = floor.getBlock(x, y);
-        block.entityId = "air";
-        
-        emit mapUpdated();
-        emit heroStatusChanged();
+        clearTile(x, y);
         return true;
     } else {
         //战斗失败，勇者hp<=0，进入gameover界面
         hero->hp = 0;
-        emit gameOver();
+        pendingGameOver = true;
         return false;
     }
 }
 
-bool Game::handleStairInteraction(int x, int y, const QString& entityId)
+bool Game::handleStairInteraction(int x, int y, EntityHandle handle)
 {
     auto hero = gameData->getHeroData();
     if (!hero) return false;
     
-    int targetLayer = -1;
-    QString targetStairId;
-    
-    if (entityId.contains("up")) {
-        targetLayer = currentFloor + 1;
-        targetStairId = "down";
-    } else if (entityId.contains("down")) {
-        targetLayer = currentFloor - 1;
-        targetStairId = "up";
-    } else {
+    // 楼梯的楼层变化在stair.txt中声明
+    int floorOffset = gameData->getStairOffset(handle);
+    if (floorOffset == 0)
         return false;
-    }
+    int targetLayer = currentFloor + floorOffset;
     
     if (targetLayer >= 0 && targetLayer < gameData->map.layers) {
         setCurrentFloor(targetLayer);
         
-        // 寻找目标楼层的对应楼梯
-        QPoint targetPos = findEntityPos(targetLayer, targetStairId);
+        // 通过位置索引寻找目标楼层的对应楼梯（上楼落在下楼梯，反之亦然）
+        QPoint targetPos = gameData->findStair(targetLayer, -floorOffset);
         if (targetPos != QPoint(-1, -1)) {
             hero->posx = targetPos.x();
             hero->posy = targetPos.y();
@@ -258,31 +396,55 @@ bool Game::handleStairInteraction(int x, int y, const QString& entityId)
             hero->posx = x;
             hero->posy = y;
         }
-        
-        emit mapUpdated();
-        emit heroStatusChanged();
         return true;
-    } else if (targetLayer >= gameData->map.layers && entityId.contains("up")) {
+    } else if (targetLayer >= gameData->map.layers && floorOffset > 0) {
         // 最高楼层上楼，触发游戏胜利
-        emit gameSuccess();
+        pendingSuccess = true;
         return true;
     }
     
     return false;
 }
 
-QPoint Game::findEntityPos(int layer, const QString& targetIdPart)
+const QVector<ManualEntry>& Game::getMonsterManual()
 {
-    if (!gameData || layer < 0 || layer >= gameData->map.layers) 
-        return QPoint(-1, -1);
+    auto hero = gameData->getHeroData();
+    if (!hero) return monsterManual;
     
-    Floor& floor = gameData->map.getFloor(layer);
-    for (int y = 0; y < gameData->map.wid; ++y) {
-        for (int x = 0; x < gameData->map.len; ++x) {
-            if (floor.getBlock(x, y).entityId.contains(targetIdPart)) {
-                return QPoint(x, y);
-            }
-        }
+    // 只有楼层、勇者攻防或本层怪物集合变化时才重新计算
+    quint32 monsterRevision = gameData->getRevision(EntityKind::Monster, currentFloor);
+    if (manualFloor == currentFloor && manualAtk == hero->atk && manualDef == hero->def
+        && manualMonsterRevision == monsterRevision) {
+        return monsterManual;
+    }
+    
+    manualFloor = currentFloor;
+    manualAtk = hero->atk;
+    manualDef = hero->def;
+    manualMonsterRevision = monsterRevision;
+    ++manualRevision;
+    
+    // 对本层每种怪物批量计算一次，同种怪物不重复计算
+    monsterManual.clear();
+    const LayerIndex& index = gameData->getLayerIndex(currentFloor);
+    for (auto it = index.byHandle.cbegin(); it != index.byHandle.cend(); ++it) {
+        if (gameData->getKind(it.key()) != EntityKind::Monster || it.value().isEmpty())
+            continue;
+        const Monster& monster = static_cast<const Monster&>(*gameData->getEntity(it.key()));
+        ManualEntry entry;
+        entry.monster = it.key();
+        entry.count = it.value().size();
+        entry.battle = forecastBattle(hero->atk, hero->def, monster);
+        monsterManual.append(entry);
     }
-    return QPoint(-1, -1);
+    
+    // 按伤害从低到高排列，无法破防的排在最后
+    std::sort(monsterManual.begin(), monsterManual.end(), [](const ManualEntry& a, const ManualEntry& b) {
+        if (a.battle.canBreak != b.battle.canBreak)
+            return a.battle.canBreak;
+        if (a.battle.damage != b.battle.damage)
+            return a.battle.damage < b.battle.damage;
+        return a.monster < b.monster;
+    });
+    return monsterManual;
 }
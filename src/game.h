@@ -6,6 +6,8 @@
 #include <QString>
 #include <QPoint>
 #include "DataManager.h"
+#include "Combat.h"
+#include "ChangeSet.h"
 
 // 定义输入动作枚举
 enum class InputAction {
@@ -16,6 +18,14 @@ enum class InputAction {
     MoveDown
 };
 
+// 怪物手册条目：本层一种怪物及其战斗预测
+struct ManualEntry
+{
+    EntityHandle monster = AIR_HANDLE;
+    int count = 0;              // 本层该怪物的数量
+    BattleForecast battle;
+};
+
 class Game : public QObject
 {
     Q_OBJECT
@@ -24,7 +34,7 @@ public:
     explicit Game(Data* data, QObject *parent = nullptr);
     ~Game();
 
-    // 处理输入动作
+    // 处理输入动作，一次输入的全部变化合并为一个stateChanged信号
     bool handleInput(InputAction action);
     
     // 设置当前楼层
@@ -35,14 +45,39 @@ public:
     
     // 获取游戏数据
     Data* getGameData() const { return gameData; }
+    
+    // 完整游戏状态（全部格子、勇者状态、当前楼层）的64位哈希，常数时间
+    quint64 stateHash() const;
+    
+    // 快速存档：只保存自加载以来变化的格子、勇者状态与当前楼层，保存为常数时间
+    static const int QUICK_SAVE_SLOTS = 10;
+    bool quickSave(int slot);
+    // 读取快速存档，作为一次状态变化发出stateChanged；槽为空时返回false
+    bool quickLoad(int slot);
+    bool hasQuickSave(int slot) const;
+    
+    // 撤销/重做：每次输入的变化记录在预先分配的环形缓冲中，超过depth时覆盖最旧的记录
+    void setUndoDepth(int depth);
+    bool undo();
+    bool redo();
+    bool canUndo() const { return undoCount > 0; }
+    bool canRedo() const { return redoCount > 0; }
+    
+    // 从加载开始产生过状态变化的输入序列，撤销/重做/快速读档时同步截断或恢复，用于录制回放
+    const QVector<InputAction>& getInputHistory() const { return inputHistory; }
+    // 撤销越过快速读档等非输入变化后，输入序列不再能重现当前状态
+    bool isInputHistoryValid() const { return historyValid; }
+    
+    // 获取当前楼层的怪物手册，按楼层/勇者攻防/怪物集合缓存
+    const QVector<ManualEntry>& getMonsterManual();
+    // 手册内容每次重新计算后递增，供界面判断是否需要刷新
+    quint32 getMonsterManualRevision() const { return manualRevision; }
 
 signals:
-    // 英雄状态改变信号
-    void heroStatusChanged();
-    // 楼层改变信号
-    void floorChanged(int floor);
-    // 地图更新信号（实体被移除等）
-    void mapUpdated();
+    // 状态变化信号：一次输入内变化的格子、勇者字段与楼层，没有变化时不发出
+    // change引用的是复用的内部缓冲，只在槽函数内有效；必须直接连接，槽中不得保留它的拷贝
+    // （拷贝会共享tiles，下次记录变化时被迫分离重新分配），需要保留时逐项拷贝
+    void stateChanged(const ChangeSet& change);
     // 消息信号
     void messageLogged(const QString& message);
     // 游戏结束信号
@@ -56,21 +91,78 @@ private:
     static const int DIR_UP = 1;
     static const int DIR_RIGHT = 2;
     static const int DIR_DOWN = 3;
+    // 输入序列按块预留容量，长时间游戏时不在每次输入中扩容
+    static const int INPUT_HISTORY_CHUNK = 4096;
+
+    // 开始/提交一次状态变化，可以嵌套，最外层提交时发出stateChanged
+    void beginChange();
+    void commitChange();
+    // 修改格子实体并记录到当前变化中
+    void setTile(int layer, int x, int y, EntityHandle handle);
+    void clearTile(int x, int y) { setTile(currentFloor, x, y, AIR_HANDLE); }
+    // 把一条变化记录反向/正向应用到当前状态
+    void applyRecord(const ChangeSet& record, bool reverse);
+    // 撤销/重做一条记录时同步输入序列
+    void unrecordInput(InputAction action);
+    void rerecordInput(InputAction action);
+    // 把一次输入追加到输入序列
+    void recordInput(InputAction action);
 
     // 处理移动逻辑
     bool processMove(int dx, int dy);
     
     // 特定实体类型的处理函数
-    bool handleDoorInteraction(int x, int y, const QString& entityId);
-    bool handleItemInteraction(int x, int y, const QString& entityId);
-    bool handleMonsterInteraction(int x, int y, const QString& entityId);
-    bool handleStairInteraction(int x, int y, const QString& entityId);
+    bool handleAirInteraction(int x, int y, EntityHandle handle);
+    bool handleBlockedInteraction(int x, int y, EntityHandle handle);
+    bool handleDoorInteraction(int x, int y, EntityHandle handle);
+    bool handleItemInteraction(int x, int y, EntityHandle handle);
+    bool handleMonsterInteraction(int x, int y, EntityHandle handle);
+    bool handleStairInteraction(int x, int y, EntityHandle handle);
     
-    // 辅助函数：在指定层寻找特定类型的实体坐标
-    QPoint findEntityPos(int layer, const QString& targetIdPart);
+    // 按EntityKind下标分派的交互函数表
+    using Interaction = bool (Game::*)(int x, int y, EntityHandle handle);
+    static const Interaction interactionTable[static_cast<int>(EntityKind::Count)];
 
     // 数据管理器指针
     Data* gameData;
     // 当前楼层
     int currentFloor;
+    
+    // 正在记录的状态变化及嵌套深度
+    ChangeSet pendingChange;
+    int changeDepth = 0;
+    // 快速存档槽
+    struct QuickSave {
+        bool valid = false;
+        TowerDelta delta;
+        int floor = 0;
+        QVector<InputAction> history;
+        bool historyValid = true;
+    };
+    QVector<QuickSave> quickSaves;
+    
+    // 撤销环形缓冲：undoHead为下一条记录写入的位置，其前undoCount条可撤销，其后redoCount条可重做
+    QVector<ChangeSet> undoRing;
+    QVector<InputAction> undoActions;   // 与undoRing一一对应，非输入产生的记录为None
+    int undoHead = 0;
+    int undoCount = 0;
+    int redoCount = 0;
+    bool replayingUndo = false;
+    
+    // 输入序列及当前正在处理的输入
+    QVector<InputAction> inputHistory;
+    bool historyValid = true;
+    InputAction pendingAction = InputAction::None;
+    
+    // 在提交变化之后发出的结局信号
+    bool pendingGameOver = false;
+    bool pendingSuccess = false;
+    
+    // 怪物手册缓存及其计算时的条件
+    QVector<ManualEntry> monsterManual;
+    int manualFloor = -1;
+    int manualAtk = 0;
+    int manualDef = 0;
+    quint32 manualMonsterRevision = 0;
+    quint32 manualRevision = 0;
 };
\ No newline at end of file
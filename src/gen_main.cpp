@@ -0,0 +1,78 @@
+#include "Config.h"
+#include "DataManager.h"
+#include "TowerGenerator.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <stdexcept>
+
+//随机塔生成工具：mota_gen 目录 [--layers 层数] [--size 边长] [--seed 种子] ...
+//在目录下写入文本地图、实体定义与精灵清单，并更新config.txt中的地图尺寸
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("生成可通关的随机魔塔，用于大尺寸下的加载、内存与绘制测试");
+    parser.addHelpOption();
+    parser.addPositionalArgument("dir", "输出目录（写入config.txt与gamedata）");
+    QCommandLineOption layersOption("layers", "层数", "n", "6");
+    QCommandLineOption sizeOption("size", "每层边长，同时设置--len与--wid", "n");
+    QCommandLineOption lenOption("len", "每层列数", "n", "12");
+    QCommandLineOption widOption("wid", "每层行数", "n", "12");
+    QCommandLineOption seedOption("seed", "随机种子", "n", "1");
+    QCommandLineOption wallsOption("walls", "墙的密度", "ratio", "0.3");
+    QCommandLineOption monstersOption("monsters", "怪物密度", "ratio", "0.08");
+    QCommandLineOption itemsOption("items", "宝石与血瓶的密度", "ratio", "0.04");
+    QCommandLineOption doorsOption("doors", "门的密度", "ratio", "0.02");
+    QCommandLineOption keysOption("keys", "主路线以外钥匙数与门数之比", "ratio", "1.0");
+    QCommandLineOption checkOption("check", "生成后从文本加载一次，报告加载时间");
+    for (const QCommandLineOption& option : {layersOption, sizeOption, lenOption, widOption, seedOption, wallsOption,
+                                             monstersOption, itemsOption, doorsOption, keysOption, checkOption})
+        parser.addOption(option);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 1)
+        parser.showHelp(1);
+    QString dir = args.first();
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    GeneratorOptions options;
+    options.layers = parser.value(layersOption).toInt();
+    options.len = parser.value(parser.isSet(sizeOption) ? sizeOption : lenOption).toInt();
+    options.wid = parser.value(parser.isSet(sizeOption) ? sizeOption : widOption).toInt();
+    options.seed = parser.value(seedOption).toUInt();
+    options.wallDensity = parser.value(wallsOption).toDouble();
+    options.monsterDensity = parser.value(monstersOption).toDouble();
+    options.itemDensity = parser.value(itemsOption).toDouble();
+    options.doorDensity = parser.value(doorsOption).toDouble();
+    options.keyRatio = parser.value(keysOption).toDouble();
+
+    try {
+        QElapsedTimer timer;
+        timer.start();
+        generateTower(options, dir);
+        out << "已生成" << dir << ": " << options.layers << "层 " << options.len << "x" << options.wid
+            << "  种子:" << options.seed << "  用时:" << timer.elapsed() << "ms" << Qt::endl;
+
+        if (parser.isSet(checkOption)) {
+            timer.start();
+            Config config;
+            config.readConfig(dir);
+            Data data(config.getInt("mapLen"), config.getInt("mapWid"), config.getInt("mapLayers"), dir, false);
+            out << "加载用时:" << timer.elapsed() << "ms  实体:" << data.handleCount() << Qt::endl;
+        }
+        return 0;
+    }
+    catch (const QString& e) {
+        err << e << Qt::endl;
+        return 1;
+    }
+    catch (const std::exception& e) {
+        err << QString::fromStdString(e.what()) << Qt::endl;
+        return 1;
+    }
+}
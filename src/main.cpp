@@ -16,6 +16,7 @@ int main(int argc, char *argv[])
 
         //根据配置创建数据管理类
         Data data(config.getInt("mapLen"), config.getInt("mapWid"), config.getInt("mapLayers"));
+        data.setFloorBudget(qint64(config.getFloorCacheSize()) << 20);
         
         // 创建主窗口并传入数据和配置
         MainWindow w(&data, &config);
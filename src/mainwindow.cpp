@@ -2,15 +2,20 @@
 #include "GameWidget.h"
 #include <QFrame>
 #include <QApplication>
+#include <QScrollArea>
 
 MainWindow::MainWindow(Data* data, Config* config, QWidget *parent)
     : QMainWindow(parent)
     , gameData(data)
     , gameConfig(config)
     , gameWidget(nullptr)
+    , manualLabel(nullptr)
+    , shownManualRevision(0)
+    , shownManualHp(-1)
 {
     setupUI();
     updateStatusPanel();
+    updateMonsterManual();
 }
 
 MainWindow::~MainWindow()
@@ -41,10 +46,12 @@ void MainWindow::setupUI()
     gameWidget = new GameWidget(gameData, gameConfig, this);
     mainLayout->addWidget(gameWidget);
     
-    connect(gameWidget, &GameWidget::heroStatusChanged, 
-            this, &MainWindow::updateStatusPanel);
-    connect(gameWidget, &GameWidget::floorChanged, 
-            this, &MainWindow::onFloorChanged);
+    QWidget* manualPanel = createMonsterManualPanel();
+    mainLayout->addWidget(manualPanel);
+    manualPanel->setFixedWidth(gameConfig->getInt("statusPanelWidth"));
+    
+    connect(gameWidget, &GameWidget::stateChanged, 
+            this, &MainWindow::onStateChanged);
     
     setStyleSheet("QMainWindow { background-color: #2d2d2d; }");
     
@@ -139,6 +146,92 @@ QWidget* MainWindow::createStatusPanel()
     return panel;
 }
 
+QWidget* MainWindow::createMonsterManualPanel()
+{
+    QFrame* panel = new QFrame(this);
+    panel->setFrameStyle(QFrame::Box | QFrame::Raised);
+    panel->setStyleSheet(
+        "QFrame { "
+        "  background-color: #3d3d3d; "
+        "  border: 2px solid #555; "
+        "  border-radius: 5px; "
+        "}"
+        "QLabel { "
+        "  color: white; "
+        "  font-size: 12px; "
+        "  padding: 5px; "
+        "}"
+    );
+    
+    QVBoxLayout* layout = new QVBoxLayout(panel);
+    layout->setSpacing(5);
+    layout->setContentsMargins(10, 10, 10, 10);
+    
+    // 标题
+    QLabel* titleLabel = new QLabel("怪物手册", panel);
+    titleLabel->setStyleSheet(
+        "font-size: 18px; "
+        "font-weight: bold; "
+        "color: #FFD700; "
+        "border-bottom: 1px solid #555; "
+        "padding-bottom: 10px;"
+    );
+    titleLabel->setAlignment(Qt::AlignCenter);
+    layout->addWidget(titleLabel);
+    
+    // 怪物列表，怪物种类多时可滚动
+    manualLabel = new QLabel(panel);
+    manualLabel->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+    manualLabel->setStyleSheet("border: none;");
+    QScrollArea* scrollArea = new QScrollArea(panel);
+    scrollArea->setWidget(manualLabel);
+    scrollArea->setWidgetResizable(true);
+    scrollArea->setStyleSheet("QScrollArea { border: none; }");
+    layout->addWidget(scrollArea);
+    
+    return panel;
+}
+
+void MainWindow::onStateChanged(const ChangeSet& change)
+{
+    if (change.floorChanged()) {
+        onFloorChanged(change.floorAfter);
+    }
+    if (change.heroChanged(HeroStats)) {
+        updateStatusPanel();
+    }
+    // 手册只取决于楼层、本层怪物与勇者的hp/攻/防
+    if (change.floorChanged() || !change.tiles.isEmpty() || change.heroChanged(HeroHp | HeroAtk | HeroDef)) {
+        updateMonsterManual();
+    }
+}
+
+void MainWindow::updateMonsterManual()
+{
+    auto hero = gameWidget->getHeroData();
+    if (!hero || !manualLabel) return;
+    
+    // 预测结果由Game按楼层缓存，这里只在手册重新计算或hp变化时刷新文本
+    Game* game = gameWidget->getGame();
+    const QVector<ManualEntry>& manual = game->getMonsterManual();
+    if (game->getMonsterManualRevision() == shownManualRevision && hero->hp == shownManualHp)
+        return;
+    shownManualRevision = game->getMonsterManualRevision();
+    shownManualHp = hero->hp;
+    
+    QStringList lines;
+    for (const ManualEntry& entry : manual) {
+        const Monster& monster = static_cast<const Monster&>(*gameData->getEntity(entry.monster));
+        QString damageText = entry.battle.canDefeat(hero->hp)
+            ? QString::number(entry.battle.damage)
+            : QString("无法战胜");
+        lines << QString("%1 x%2").arg(monster.id).arg(entry.count);
+        lines << QString("  HP:%1 攻:%2 防:%3").arg(monster.hp).arg(monster.atk).arg(monster.def);
+        lines << QString("  伤害: %1").arg(damageText);
+    }
+    manualLabel->setText(lines.isEmpty() ? QString("本层没有怪物") : lines.join("\n"));
+}
+
 void MainWindow::updateStatusPanel()
 {
     auto hero = gameWidget->getHeroData();
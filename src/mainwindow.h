@@ -8,6 +8,7 @@
 #include <QHBoxLayout>
 #include "DataManager.h"
 #include "Config.h"
+#include "ChangeSet.h"
 
 class GameWidget;
 
@@ -20,15 +21,21 @@ public:
     ~MainWindow();
 
 private slots:
+    // 按变化记录只刷新受影响的面板
+    void onStateChanged(const ChangeSet& change);
     // 更新状态面板
     void updateStatusPanel();
     // 楼层变化
     void onFloorChanged(int floor);
+    // 更新怪物手册
+    void updateMonsterManual();
 private:
     // 初始化UI
     void setupUI();
     // 创建状态面板
     QWidget* createStatusPanel();
+    // 创建怪物手册面板
+    QWidget* createMonsterManualPanel();
 
     // 数据管理器
     Data* gameData;
@@ -45,4 +52,9 @@ private:
     QLabel* yellowKeyLabel;
     QLabel* blueKeyLabel;
     QLabel* redKeyLabel;
+
+    // 怪物手册标签及上次刷新时的手册版本与勇者hp
+    QLabel* manualLabel;
+    quint32 shownManualRevision;
+    int shownManualHp;
 };
@@ -0,0 +1,47 @@
+#include "Config.h"
+#include "DataManager.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <stdexcept>
+
+//塔文件打包工具：mota-pack [目录] [-o 输出文件]
+//读取目录下config.txt与gamedata中的文本地图和实体，编译为二进制塔文件
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("把gamedata中的文本地图与实体编译为二进制塔文件");
+    parser.addHelpOption();
+    parser.addPositionalArgument("dir", "config.txt与gamedata所在目录，默认为程序所在目录");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "输出文件，默认为gamedata/tower.bin", "file");
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    QString dir = parser.positionalArguments().value(0);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    try {
+        Config config;
+        config.readConfig(dir);
+        //始终从文本加载，避免读到旧的塔文件
+        Data data(config.getInt("mapLen"), config.getInt("mapWid"), config.getInt("mapLayers"), dir, false);
+
+        QString output = parser.isSet(outputOption) ? parser.value(outputOption) : data.getTowerPath();
+        data.SaveTower(output);
+
+        out << "已生成" << output << ": " << data.map.layers << "层 " << data.map.len << "x" << data.map.wid
+            << ", " << data.handleCount() << "个实体" << Qt::endl;
+        return 0;
+    }
+    catch (const QString& e) {
+        err << e << Qt::endl;
+        return 1;
+    }
+    catch (const std::exception& e) {
+        err << QString::fromStdString(e.what()) << Qt::endl;
+        return 1;
+    }
+}
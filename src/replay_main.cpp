@@ -0,0 +1,89 @@
+#include "Config.h"
+#include "DataManager.h"
+#include "game.h"
+#include "Replay.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <stdexcept>
+
+//命令行回放：mota_replay [-d 目录] 录像文件...
+//在同一份塔数据上依次全速回放每个录像，任一录像与录制时不一致则返回1
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("魔塔录像回放：无界面执行录像中的输入，校验塔内容与最终状态");
+    parser.addHelpOption();
+    parser.addPositionalArgument("replays", "录像文件(.mrp)", "replays...");
+    QCommandLineOption dirOption(QStringList() << "d" << "dir", "config.txt与gamedata所在目录，默认为程序所在目录", "dir");
+    parser.addOption(dirOption);
+    parser.process(app);
+
+    const QStringList files = parser.positionalArguments();
+    if (files.isEmpty())
+        parser.showHelp(2);
+    QString dir = parser.value(dirOption);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    try {
+        Config config;
+        config.readConfig(dir);
+        Data data(config.getInt("mapLen"), config.getInt("mapWid"), config.getInt("mapLayers"), dir);
+
+        //回放不需要撤销记录；初始状态存入快速存档，每个录像开始前读回
+        Game game(&data);
+        game.setUndoDepth(0);
+        game.quickSave(0);
+
+        int diverged = 0;
+        qint64 totalActions = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for (const QString& file : files) {
+            try {
+                Replay replay = Replay::load(file);
+                game.quickLoad(0);
+                ReplayResult result = runReplay(game, replay);
+                totalActions += result.executed;
+
+                QString status = "通过";
+                if (!result.towerMatched)
+                    status = "塔内容已改变";
+                else if (result.stoppedEarly)
+                    status = "提前结束";
+                else if (!result.finalMatched)
+                    status = "最终状态不一致";
+                if (result.diverged())
+                    ++diverged;
+
+                const HeroState& hero = result.hero;
+                out << file << ": " << status << "  输入:" << result.executed << "/" << replay.actions.size()
+                    << "  " << result.floor + 1 << "F HP:" << hero.hp << " 攻击:" << hero.atk
+                    << " 防御:" << hero.def << " 金币:" << hero.gold
+                    << (result.success ? "  胜利" : result.gameOver ? "  失败" : "")
+                    << "  哈希:" << QString::number(result.finalHash, 16) << Qt::endl;
+            }
+            catch (const QString& e) {
+                err << e << Qt::endl;
+                ++diverged;
+            }
+        }
+
+        qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+        out << "录像:" << files.size() << "  不一致:" << diverged << "  输入:" << totalActions
+            << "  用时:" << elapsed << "ms  (" << totalActions * 1000 / elapsed << " 输入/秒)" << Qt::endl;
+        return diverged > 0 ? 1 : 0;
+    }
+    catch (const QString& e) {
+        err << e << Qt::endl;
+        return 2;
+    }
+    catch (const std::exception& e) {
+        err << QString::fromStdString(e.what()) << Qt::endl;
+        return 2;
+    }
+}
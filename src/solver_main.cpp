@@ -0,0 +1,68 @@
+#include "Config.h"
+#include "DataManager.h"
+#include "Solver.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <stdexcept>
+
+//命令行求解器：mota_solver [目录] [-t 线程数] [--max-states 状态数]
+//目录下需要有config.txt与gamedata，默认使用程序所在目录
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("魔塔最优路线求解器：搜索离开顶层时hp最高（gold次之）的交互顺序");
+    parser.addHelpOption();
+    parser.addPositionalArgument("dir", "config.txt与gamedata所在目录，默认为程序所在目录");
+    QCommandLineOption threadsOption(QStringList() << "t" << "threads", "工作线程数，默认使用全部核心", "n", "0");
+    QCommandLineOption maxStatesOption("max-states", "最多展开的状态数，默认不限制", "n", "0");
+    parser.addOption(threadsOption);
+    parser.addOption(maxStatesOption);
+    parser.process(app);
+
+    QString dir = parser.positionalArguments().value(0);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    try {
+        Config config;
+        config.readConfig(dir);
+        Data data(config.getInt("mapLen"), config.getInt("mapWid"), config.getInt("mapLayers"), dir);
+
+        SolverOptions options;
+        options.threads = parser.value(threadsOption).toInt();
+        options.maxStates = parser.value(maxStatesOption).toLongLong();
+
+        Solver solver(&data, 0);
+        SolverResult result = solver.solve(options);
+
+        out << "展开状态: " << result.expanded << "  剪枝: " << result.pruned
+            << "  用时: " << result.elapsedMs << "ms" << Qt::endl;
+        if (result.truncated)
+            out << "已达到状态上限，结果不保证最优" << Qt::endl;
+        if (!result.solved) {
+            out << "未找到离开顶层的路线" << Qt::endl;
+            return 1;
+        }
+
+        for (const SolverStep& step : std::as_const(result.steps)) {
+            out << step.layer + 1 << "F (" << step.x << "," << step.y << ") "
+                << data.getEntityId(step.handle) << Qt::endl;
+        }
+        const HeroState& hero = result.hero;
+        out << "最终 HP:" << hero.hp << " 攻击:" << hero.atk << " 防御:" << hero.def
+            << " 金币:" << hero.gold << " 钥匙:" << hero.yellow_key << "/" << hero.blue_key
+            << "/" << hero.red_key << Qt::endl;
+        return 0;
+    }
+    catch (const QString& e) {
+        err << e << Qt::endl;
+        return 2;
+    }
+    catch (const std::exception& e) {
+        err << QString::fromStdString(e.what()) << Qt::endl;
+        return 2;
+    }
+}